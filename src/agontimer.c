@@ -2,15 +2,19 @@
  * Title:			AGON timer interface
  * Author:			Jeroen Venema
  * Created:			06/11/2022
- * Last Updated:	12/04/2025
+ * Last Updated:	14/10/2026
  * 
  * Modinfo:
  * 06/11/2022:		Initial version
  * 12/04/2025:      Updated for agondev
+ * 14/10/2026:      Free running TMR1 clock for measurements
+ *                  System clock measurement against the RTC
+ *                  RTC selected as the TMR2 source through TMR_ISS
  */
 
 #include "ez80f92.h"
 #include <stdint.h>
+#include "agontimer.h"
 
 #define TMR0_COUNTER_1ms	(unsigned short)(((18432000 / 1000) * 1) / 16)
 
@@ -38,3 +42,93 @@ void delayms(int ms)
 		ms--;
 	}
 }
+
+// TMR1 runs continuously at 18.432MHz / 256 = 72KHz, reloading at 0xFFFF
+// The 16bit counter wraps every 0.91s and is extended in software, so timer_ticks
+// needs to be called at least that often to keep track of elapsed time
+static uint16_t timer_last;
+static uint32_t timer_total;
+
+static uint16_t timer_read(void) {
+	uint16_t timer1;
+
+	timer1 = IO(TMR1_DR_L);
+	timer1 |= (IO(TMR1_DR_H) << 8);
+	return timer1;
+}
+
+void timer_start(void)
+{
+	IO(TMR1_CTL) = 0x00;	// disable timer1
+	IO(TMR1_RR_H) = 0xFF;
+	IO(TMR1_RR_L) = 0xFF;
+	IO(TMR1_CTL) = 0x1F;	// enable, continuous, divide by 256, start countdown immediately
+
+	timer_last = timer_read();
+	timer_total = 0;
+}
+
+uint32_t timer_ticks(void)
+{
+	uint16_t now = timer_read();
+
+	timer_total += (uint16_t)(timer_last - now); // counting down
+	timer_last = now;
+	return timer_total;
+}
+
+#define RTC_FREQUENCY		32768
+#define CLOCK_RTCTICKS		4096	// 125ms, measured in system clock / 256 ticks: clock = ticks * 2048
+
+static uint16_t timer2_read(void) {
+	uint16_t timer2;
+
+	timer2 = IO(TMR2_DR_L);
+	timer2 |= (IO(TMR2_DR_H) << 8);
+	return timer2;
+}
+
+// Counts system clock / 256 ticks on the free running TMR1, during CLOCK_RTCTICKS ticks
+// of TMR2, which needs to be counting RTC ticks. Returns 0 when the RTC isn't running
+static uint32_t timer2_measure(void) {
+	uint16_t start, now;
+	uint32_t begin;
+
+	// Synchronize to an RTC tick
+	begin = timer_ticks();
+	start = timer2_read();
+	while((now = timer2_read()) == start) {
+		if((timer_ticks() - begin) > (10 * TIMER_TICKS_PER_MS)) return 0;
+	}
+
+	begin = timer_ticks();
+	while((uint16_t)(now - timer2_read()) < CLOCK_RTCTICKS) {
+		if((timer_ticks() - begin) > (250 * TIMER_TICKS_PER_MS)) return 0;
+	}
+	return timer_ticks() - begin;
+}
+
+// Measures the system clock against the 32768Hz RTC crystal, with TMR2 counting RTC ticks
+// and the free running TMR1, which needs to be started, counting system clock / 256 ticks
+// TMR2 and its input source selection are restored afterwards
+// Returns the clock in Hz, or 0 when the RTC isn't running
+uint32_t timer_measureclock(void)
+{
+	uint8_t iss, ctl;
+	uint32_t ticks;
+
+	iss = IO(TMR_ISS);
+	ctl = IO(TMR2_CTL);
+	IO(TMR2_CTL) = 0x00;	// disable timer2
+	IO(TMR2_RR_H) = 0xFF;
+	IO(TMR2_RR_L) = 0xFF;
+	IO(TMR_ISS) = (iss & 0xCF) | 0x10;	// TMR2_IN bits 5:4, 01 - RTC clock source
+	IO(TMR2_CTL) = 0x13;	// enable, continuous, start countdown immediately
+
+	ticks = timer2_measure();
+
+	IO(TMR2_CTL) = 0x00;
+	IO(TMR_ISS) = iss;
+	IO(TMR2_CTL) = ctl;
+	return ticks * (256 * RTC_FREQUENCY / CLOCK_RTCTICKS);
+}
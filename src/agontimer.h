@@ -2,15 +2,25 @@
  * Title:			AGON timer interface
  * Author:			Jeroen Venema
  * Created:			06/11/2022
- * Last Updated:	06/11/2022
+ * Last Updated:	14/10/2026
  * 
  * Modinfo:
  * 06/11/2022:		Initial version
+ * 14/10/2026:      Free running timer for measurements
+ *                  System clock measurement against the RTC
  */
 
 #ifndef AGONTIMER_H
 #define AGONTIMER_H
 
+#include <stdint.h>
+
+#define TIMER_TICKS_PER_MS	72	// 18.432MHz / 256
+#define SYSCLK_NOMINAL		18432000
+
 void delayms(int ms);
+void timer_start(void);
+uint32_t timer_ticks(void);
+uint32_t timer_measureclock(void);
 
 #endif //AGONTIMER_H
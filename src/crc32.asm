@@ -1,224 +1,376 @@
-;
-; Title:	crc32
-; Author:	Leigh Brown
-; Created:	26/05/2023
-; Last Updated:	13/04/2025 - Jeroen Venema
-
-; Modinfo
-;	crc32 can han.d32e different blocks now
-;   crc32 is now assembled using gnu-as
-
-	.global	_crc32
-	.global	_crc32_initialize
-	.global	_crc32_finalize
-
-    .assume adl = 1	
-    .text
-; UINT32 crc32(const char *s, UINT24 len);
-;              IX+6           IX+9
-; NB: We use local stack storage without allocating it by decrementing SP.
-;     That's okay, /as.d32 as/ we don't call any other functions.
-
-_crc32_initialize:
-    ; Initialise output to 0xFFFFFFFF
-    EXX
-    LD      A, $FF
-    LD      (crc32result+3), A
-    LD      (crc32result+2), A
-    LD      (crc32result+1), A
-    LD      (crc32result), A
-    EXX
-
-    ; replacement for LD HL, crc32_lookup_table >> 2
-    ; which doesn't work in gnu-as with linked code segments, where the symbol address is unknown at assembly
-    PUSH    HL
-    LD      HL, crc32_lookup_table      ; load address of the crc32_lookup_table
-    LD      (shiftedtable), HL          ; save the address, so we can reach the upper byte individually
-    LD      A, (shiftedtable+2)         ; get HLU
-    SRL     A                           ; start shifting 1st bit
-    RR      H
-    RR      L
-    SRL     A                           ; start shifting 2nd bit
-    RR      H
-    RR      L
-    LD      (shiftedtable), HL
-    LD      (shiftedtable+2), A         ; crc32_lookup_table >> 2 is now stored in (shiftedtable) 
-    POP     HL
-    RET
-
-_crc32_finalize:
-	PUSH	IX
-	LD		IX,0
-	ADD		IX,SP
-
-    LD      A, (crc32result+3)
-    CPL
-    LD      (crc32result+3), A
-    LD      A, (crc32result+2)
-    CPL
-    LD      (crc32result+2), A
-    LD      A, (crc32result+1)
-    CPL
-    LD      (crc32result+1), A
-    LD      A, (crc32result)
-    CPL
-    LD      (crc32result), A
-
-	LD      A, (crc32result+3)
-	LD      DE, 0
-	LD      E, A
-	LD      HL, (crc32result)
-	POP     IX
-	RET
-
-_crc32:
-	; Function prologue
-	PUSH	IX
-	LD		IX,0
-	ADD		IX,SP
-
-	LD		DE, (IX+6)
-	LD		HL, (IX+9)
-; expects DE to point to buffer to check
-; expects HL to contain the bytecount
-    LD		BC,1
-
-    EXX
-    LD      A, (crc32result+3)
-    LD      D, A
-    LD      A, (crc32result+2)
-    LD      E, A
-    LD      A, (crc32result+1)
-    LD      B, A
-    LD      A, (crc32result)
-    LD      C, A
-    EXX
-
-1:
-    LD      A,(DE)
-    INC     DE
-    
-    ; Calculate offset into lookup table
-    EXX
-    XOR     C
-    LD      HL, (shiftedtable) ;LD	HL,crc32_lookup_table >> 2
-    LD      L,A
-    ADD     HL,HL
-    ADD     HL,HL
-
-    LD      A,B
-    XOR     (HL)
-    INC     HL
-    LD      C,A
-
-    LD      A,E
-    XOR     (HL)
-    INC     HL
-    LD      B,A
-
-    LD      A,D
-    XOR     (HL)
-    INC     HL
-    LD      E,A
-
-    LD      D,(HL)
-    EXX
-
-    ; Decrement count and loop if not zero
-    OR      A,A
-    SBC     HL,BC
-    JR      NZ,1b
-
-    EXX
-    LD      A, D
-    LD      (crc32result+3), A
-    LD      A, E
-    LD      (crc32result+2), A
-    LD      A, B
-    LD      (crc32result+1), A
-    LD      A, C
-    LD      (crc32result), A
-    EXX
-
-	; Function epilogue
-	POP     IX
-	RET
-
-    .section .rodata
-		; The crc32 routine is optimised in such a way as to require
-		; the following table to be aligned on a 1024 byte boundary.
-
-		.ALIGN	10
-crc32_lookup_table:
-		.d32	$00000000, $77073096, $ee0e612c, $990951ba
-		.d32	$076dc419, $706af48f, $e963a535, $9e6495a3
-		.d32	$0edb8832, $79dcb8a4, $e0d5e91e, $97d2d988
-		.d32	$09b64c2b, $7eb17cbd, $e7b82d07, $90bf1d91
-		.d32	$1db71064, $6ab020f2, $f3b97148, $84be41de
-		.d32	$1adad47d, $6ddde4eb, $f4d4b551, $83d385c7
-		.d32	$136c9856, $646ba8c0, $fd62f97a, $8a65c9ec
-		.d32	$14015c4f, $63066cd9, $fa0f3d63, $8d080df5
-		.d32	$3b6e20c8, $4c69105e, $d56041e4, $a2677172
-		.d32	$3c03e4d1, $4b04d447, $d20d85fd, $a50ab56b
-		.d32	$35b5a8fa, $42b2986c, $dbbbc9d6, $acbcf940
-		.d32	$32d86ce3, $45df5c75, $dcd60dcf, $abd13d59
-		.d32	$26d930ac, $51de003a, $c8d75180, $bfd06116
-		.d32	$21b4f4b5, $56b3c423, $cfba9599, $b8bda50f
-		.d32	$2802b89e, $5f058808, $c60cd9b2, $b10be924
-		.d32	$2f6f7c87, $58684c11, $c1611dab, $b6662d3d
-		.d32	$76dc4190, $01db7106, $98d220bc, $efd5102a
-		.d32	$71b18589, $06b6b51f, $9fbfe4a5, $e8b8d433
-		.d32	$7807c9a2, $0f00f934, $9609a88e, $e10e9818
-		.d32	$7f6a0dbb, $086d3d2d, $91646c97, $e6635c01
-		.d32	$6b6b51f4, $1c6c6162, $856530d8, $f262004e
-		.d32	$6c0695ed, $1b01a57b, $8208f4c1, $f50fc457
-		.d32	$65b0d9c6, $12b7e950, $8bbeb8ea, $fcb9887c
-		.d32	$62dd1ddf, $15da2d49, $8cd37cf3, $fbd44c65
-		.d32	$4db26158, $3ab551ce, $a3bc0074, $d4bb30e2
-		.d32	$4adfa541, $3dd895d7, $a4d1c46d, $d3d6f4fb
-		.d32	$4369e96a, $346ed9fc, $ad678846, $da60b8d0
-		.d32	$44042d73, $33031de5, $aa0a4c5f, $dd0d7cc9
-		.d32	$5005713c, $270241aa, $be0b1010, $c90c2086
-		.d32	$5768b525, $206f85b3, $b966d409, $ce61e49f
-		.d32	$5edef90e, $29d9c998, $b0d09822, $c7d7a8b4
-		.d32	$59b33d17, $2eb40d81, $b7bd5c3b, $c0ba6cad
-		.d32	$edb88320, $9abfb3b6, $03b6e20c, $74b1d29a
-		.d32	$ead54739, $9dd277af, $04db2615, $73dc1683
-		.d32	$e3630b12, $94643b84, $0d6d6a3e, $7a6a5aa8
-		.d32	$e40ecf0b, $9309ff9d, $0a00ae27, $7d079eb1
-		.d32	$f00f9344, $8708a3d2, $1e01f268, $6906c2fe
-		.d32	$f762575d, $806567cb, $196c3671, $6e6b06e7
-		.d32	$fed41b76, $89d32be0, $10da7a5a, $67dd4acc
-		.d32	$f9b9df6f, $8ebeeff9, $17b7be43, $60b08ed5
-		.d32	$d6d6a3e8, $a1d1937e, $38d8c2c4, $4fdff252
-		.d32	$d1bb67f1, $a6bc5767, $3fb506dd, $48b2364b
-		.d32	$d80d2bda, $af0a1b4c, $36034af6, $41047a60
-		.d32	$df60efc3, $a867df55, $316e8eef, $4669be79
-		.d32	$cb61b38c, $bc66831a, $256fd2a0, $5268e236
-		.d32	$cc0c7795, $bb0b4703, $220216b9, $5505262f
-		.d32	$c5ba3bbe, $b2bd0b28, $2bb45a92, $5cb36a04
-		.d32	$c2d7ffa7, $b5d0cf31, $2cd99e8b, $5bdeae1d
-		.d32	$9b64c2b0, $ec63f226, $756aa39c, $026d930a
-		.d32	$9c0906a9, $eb0e363f, $72076785, $05005713
-		.d32	$95bf4a82, $e2b87a14, $7bb12bae, $0cb61b38
-		.d32	$92d28e9b, $e5d5be0d, $7cdcefb7, $0bdbdf21
-		.d32	$86d3d2d4, $f1d4e242, $68ddb3f8, $1fda836e
-		.d32	$81be16cd, $f6b9265b, $6fb077e1, $18b74777
-		.d32	$88085ae6, $ff0f6a70, $66063bca, $11010b5c
-		.d32	$8f659eff, $f862ae69, $616bffd3, $166ccf45
-		.d32	$a00ae278, $d70dd2ee, $4e048354, $3903b3c2
-		.d32	$a7672661, $d06016f7, $4969474d, $3e6e77db
-		.d32	$aed16a4a, $d9d65adc, $40df0b66, $37d83bf0
-		.d32	$a9bcae53, $debb9ec5, $47b2cf7f, $30b5ffe9
-		.d32	$bdbdf21c, $cabac28a, $53b39330, $24b4a3a6
-		.d32	$bad03605, $cdd70693, $54de5729, $23d967bf
-		.d32	$b3667a2e, $c4614ab8, $5d681b02, $2a6f2b94
-		.d32	$b40bbe37, $c30c8ea1, $5a05df1b, $2d02ef8d	
-
-    .data
-crc32result:
-    .d32 0
-shiftedtable:
-    .d24 0
-
-		END
+;
+; Title:	crc32
+; Author:	Leigh Brown
+; Created:	26/05/2023
+; Last Updated:	14/10/2026 - Jeroen Venema
+
+; Modinfo
+;	crc32 can han.d32e different blocks now
+;   crc32 is now assembled using gnu-as
+;   14/10/2026: Faster kernel - byte-plane lookup tables, no EXX per byte
+;               4x unrolled loop, rotating the CRC registers instead of moving them
+;               Running CRC can be suspended and resumed around another CRC
+
+	.global	_crc32
+	.global	_crc32_initialize
+	.global	_crc32_finalize
+	.global	_crc32_suspend
+	.global	_crc32_resume
+
+    .assume adl = 1	
+    .text
+; UINT32 crc32(const char *s, UINT24 len);
+;              IX+6           IX+9
+;
+; The lookup table is split in 4 planes of 256 bytes, one per byte of each 32bit
+; table entry. With L as the index, H selects the plane, so a byte only needs
+; INC H/DEC H between the four lookups.
+; The four CRC bytes live in C,B,E,D. Each step computes
+;   crc = (crc >> 8) ^ table[(crc ^ byte) & 0xFF]
+; and leaves the shifted CRC in the registers rotated by one position.
+; After four steps the CRC is back in C,B,E,D, so the loop handles 4 bytes
+; per iteration, with alternating plane order to avoid resetting H.
+
+_crc32_initialize:
+    ; Initialise output to 0xFFFFFFFF
+    LD      A, $FF
+    LD      (crc32result+3), A
+    LD      (crc32result+2), A
+    LD      (crc32result+1), A
+    LD      (crc32result), A
+    RET
+
+_crc32_finalize:
+	PUSH	IX
+	LD		IX,0
+	ADD		IX,SP
+
+    LD      A, (crc32result+3)
+    CPL
+    LD      (crc32result+3), A
+    LD      A, (crc32result+2)
+    CPL
+    LD      (crc32result+2), A
+    LD      A, (crc32result+1)
+    CPL
+    LD      (crc32result+1), A
+    LD      A, (crc32result)
+    CPL
+    LD      (crc32result), A
+
+	LD      A, (crc32result+3)
+	LD      DE, 0
+	LD      E, A
+	LD      HL, (crc32result)
+	POP     IX
+	RET
+
+; void crc32_suspend(uint32_t *state);
+; void crc32_resume(const uint32_t *state);
+;                   IX+6
+; Saves/restores the running CRC, so another CRC can be calculated in between
+_crc32_suspend:
+	PUSH	IX
+	LD		IX,0
+	ADD		IX,SP
+	LD		DE, (IX+6)
+	LD		HL, crc32result
+	JR		1f
+_crc32_resume:
+	PUSH	IX
+	LD		IX,0
+	ADD		IX,SP
+	LD		HL, (IX+6)
+	LD		DE, crc32result
+1:
+	LD		BC, 4
+	LDIR
+	POP		IX
+	RET
+
+_crc32:
+	; Function prologue
+	PUSH	IX
+	LD		IX,0
+	ADD		IX,SP
+	PUSH	IY
+
+	LD		IY, (IX+6)		; buffer to check
+	LD		HL, (IX+9)		; bytecount
+	LD		DE, 0
+	OR		A, A
+	SBC		HL, DE
+	JP		Z, crc32_exit
+
+	; split bytecount in (bytecount >> 2) groups of 4 and (bytecount & 3) single bytes
+	LD		(crc32count), HL
+	LD		A, L
+	AND		A, 3
+	LD		(crc32single), A
+	LD		A, (crc32count+2)
+	SRL		A
+	RR		H
+	RR		L
+	SRL		A
+	RR		H
+	RR		L
+	LD		(crc32count), HL
+	LD		(crc32count+2), A	; number of groups
+
+	; outer loop count, each outer iteration runs the inner loop 256 times, except the first
+	LD		HL, 0
+	LD		A, (crc32count+1)
+	LD		L, A
+	LD		A, (crc32count+2)
+	LD		H, A
+	LD		A, (crc32count)
+	OR		A, A
+	JR		Z, 1f
+	INC		HL				; first outer iteration handles the remaining groups
+1:
+	LD		(crc32outer), HL
+
+	; load CRC
+	LD		A, (crc32result)
+	LD		C, A
+	LD		A, (crc32result+1)
+	LD		B, A
+	LD		A, (crc32result+2)
+	LD		E, A
+	LD		A, (crc32result+3)
+	LD		D, A
+	LD		HL, crc32_lookup_table
+
+	; single bytes first
+	LD		A, (crc32single)
+	OR		A, A
+	JR		Z, crc32_groups
+	LD		IXL, A
+crc32_byte:
+	LD		A, (IY+0)
+	INC		IY
+	XOR		A, C
+	LD		L, A
+	LD		A, B
+	XOR		A, (HL)
+	LD		B, A
+	INC		H
+	LD		A, E
+	XOR		A, (HL)
+	LD		E, A
+	INC		H
+	LD		A, D
+	XOR		A, (HL)
+	LD		D, A
+	INC		H
+	LD		A, (HL)
+	DEC		H
+	DEC		H
+	DEC		H
+	; rotate back to C,B,E,D
+	LD		C, B
+	LD		B, E
+	LD		E, D
+	LD		D, A
+	DEC		IXL
+	JR		NZ, crc32_byte
+
+crc32_groups:
+	; outer count is at most $4001, zero means less than 4 bytes in total
+	LD		A, (crc32outer)
+	PUSH	HL
+	LD		HL, crc32outer+1
+	OR		A, (HL)
+	POP		HL
+	JR		Z, crc32_store
+	LD		A, (crc32count)
+	LD		IXL, A				; 0 runs 256 times
+
+	; Registers: IY - buffer, H - table plane, CRC in C,B,E,D
+crc32_loop:
+	; byte 0, CRC in C,B,E,D, planes 0->3
+	LD		A, (IY+0)
+	XOR		A, C
+	LD		L, A
+	LD		A, B
+	XOR		A, (HL)
+	LD		B, A
+	INC		H
+	LD		A, E
+	XOR		A, (HL)
+	LD		E, A
+	INC		H
+	LD		A, D
+	XOR		A, (HL)
+	LD		D, A
+	INC		H
+	LD		C, (HL)
+	; byte 1, CRC in B,E,D,C, planes 3->0
+	LD		A, (IY+1)
+	XOR		A, B
+	LD		L, A
+	LD		B, (HL)
+	DEC		H
+	LD		A, C
+	XOR		A, (HL)
+	LD		C, A
+	DEC		H
+	LD		A, D
+	XOR		A, (HL)
+	LD		D, A
+	DEC		H
+	LD		A, E
+	XOR		A, (HL)
+	LD		E, A
+	; byte 2, CRC in E,D,C,B, planes 0->3
+	LD		A, (IY+2)
+	XOR		A, E
+	LD		L, A
+	LD		A, D
+	XOR		A, (HL)
+	LD		D, A
+	INC		H
+	LD		A, C
+	XOR		A, (HL)
+	LD		C, A
+	INC		H
+	LD		A, B
+	XOR		A, (HL)
+	LD		B, A
+	INC		H
+	LD		E, (HL)
+	; byte 3, CRC in D,C,B,E, planes 3->0
+	LD		A, (IY+3)
+	XOR		A, D
+	LD		L, A
+	LD		D, (HL)
+	DEC		H
+	LD		A, E
+	XOR		A, (HL)
+	LD		E, A
+	DEC		H
+	LD		A, B
+	XOR		A, (HL)
+	LD		B, A
+	DEC		H
+	LD		A, C
+	XOR		A, (HL)
+	LD		C, A
+	; CRC back in C,B,E,D
+	LEA		IY, IY+4
+	DEC		IXL
+	JR		NZ, crc32_loop
+
+	PUSH	HL
+	PUSH	DE
+	LD		HL, (crc32outer)
+	LD		DE, 1
+	OR		A, A
+	SBC		HL, DE
+	LD		(crc32outer), HL
+	POP		DE
+	POP		HL
+	JR		NZ, crc32_loop
+
+crc32_store:
+	LD		A, C
+	LD		(crc32result), A
+	LD		A, B
+	LD		(crc32result+1), A
+	LD		A, E
+	LD		(crc32result+2), A
+	LD		A, D
+	LD		(crc32result+3), A
+
+crc32_exit:
+	; Function epilogue
+	POP		IY
+	POP     IX
+	RET
+
+    .section .rodata
+		; The crc32 routine requires the following table to be aligned on a 1024 byte boundary,
+		; so the four 256 byte planes share the same upper address bytes.
+
+		.ALIGN	10
+crc32_lookup_table:
+		; byte 0 of each table entry
+		.db	$00, $96, $2c, $ba, $19, $8f, $35, $a3, $32, $a4, $1e, $88, $2b, $bd, $07, $91
+		.db	$64, $f2, $48, $de, $7d, $eb, $51, $c7, $56, $c0, $7a, $ec, $4f, $d9, $63, $f5
+		.db	$c8, $5e, $e4, $72, $d1, $47, $fd, $6b, $fa, $6c, $d6, $40, $e3, $75, $cf, $59
+		.db	$ac, $3a, $80, $16, $b5, $23, $99, $0f, $9e, $08, $b2, $24, $87, $11, $ab, $3d
+		.db	$90, $06, $bc, $2a, $89, $1f, $a5, $33, $a2, $34, $8e, $18, $bb, $2d, $97, $01
+		.db	$f4, $62, $d8, $4e, $ed, $7b, $c1, $57, $c6, $50, $ea, $7c, $df, $49, $f3, $65
+		.db	$58, $ce, $74, $e2, $41, $d7, $6d, $fb, $6a, $fc, $46, $d0, $73, $e5, $5f, $c9
+		.db	$3c, $aa, $10, $86, $25, $b3, $09, $9f, $0e, $98, $22, $b4, $17, $81, $3b, $ad
+		.db	$20, $b6, $0c, $9a, $39, $af, $15, $83, $12, $84, $3e, $a8, $0b, $9d, $27, $b1
+		.db	$44, $d2, $68, $fe, $5d, $cb, $71, $e7, $76, $e0, $5a, $cc, $6f, $f9, $43, $d5
+		.db	$e8, $7e, $c4, $52, $f1, $67, $dd, $4b, $da, $4c, $f6, $60, $c3, $55, $ef, $79
+		.db	$8c, $1a, $a0, $36, $95, $03, $b9, $2f, $be, $28, $92, $04, $a7, $31, $8b, $1d
+		.db	$b0, $26, $9c, $0a, $a9, $3f, $85, $13, $82, $14, $ae, $38, $9b, $0d, $b7, $21
+		.db	$d4, $42, $f8, $6e, $cd, $5b, $e1, $77, $e6, $70, $ca, $5c, $ff, $69, $d3, $45
+		.db	$78, $ee, $54, $c2, $61, $f7, $4d, $db, $4a, $dc, $66, $f0, $53, $c5, $7f, $e9
+		.db	$1c, $8a, $30, $a6, $05, $93, $29, $bf, $2e, $b8, $02, $94, $37, $a1, $1b, $8d
+		; byte 1 of each table entry
+		.db	$00, $30, $61, $51, $c4, $f4, $a5, $95, $88, $b8, $e9, $d9, $4c, $7c, $2d, $1d
+		.db	$10, $20, $71, $41, $d4, $e4, $b5, $85, $98, $a8, $f9, $c9, $5c, $6c, $3d, $0d
+		.db	$20, $10, $41, $71, $e4, $d4, $85, $b5, $a8, $98, $c9, $f9, $6c, $5c, $0d, $3d
+		.db	$30, $00, $51, $61, $f4, $c4, $95, $a5, $b8, $88, $d9, $e9, $7c, $4c, $1d, $2d
+		.db	$41, $71, $20, $10, $85, $b5, $e4, $d4, $c9, $f9, $a8, $98, $0d, $3d, $6c, $5c
+		.db	$51, $61, $30, $00, $95, $a5, $f4, $c4, $d9, $e9, $b8, $88, $1d, $2d, $7c, $4c
+		.db	$61, $51, $00, $30, $a5, $95, $c4, $f4, $e9, $d9, $88, $b8, $2d, $1d, $4c, $7c
+		.db	$71, $41, $10, $20, $b5, $85, $d4, $e4, $f9, $c9, $98, $a8, $3d, $0d, $5c, $6c
+		.db	$83, $b3, $e2, $d2, $47, $77, $26, $16, $0b, $3b, $6a, $5a, $cf, $ff, $ae, $9e
+		.db	$93, $a3, $f2, $c2, $57, $67, $36, $06, $1b, $2b, $7a, $4a, $df, $ef, $be, $8e
+		.db	$a3, $93, $c2, $f2, $67, $57, $06, $36, $2b, $1b, $4a, $7a, $ef, $df, $8e, $be
+		.db	$b3, $83, $d2, $e2, $77, $47, $16, $26, $3b, $0b, $5a, $6a, $ff, $cf, $9e, $ae
+		.db	$c2, $f2, $a3, $93, $06, $36, $67, $57, $4a, $7a, $2b, $1b, $8e, $be, $ef, $df
+		.db	$d2, $e2, $b3, $83, $16, $26, $77, $47, $5a, $6a, $3b, $0b, $9e, $ae, $ff, $cf
+		.db	$e2, $d2, $83, $b3, $26, $16, $47, $77, $6a, $5a, $0b, $3b, $ae, $9e, $cf, $ff
+		.db	$f2, $c2, $93, $a3, $36, $06, $57, $67, $7a, $4a, $1b, $2b, $be, $8e, $df, $ef
+		; byte 2 of each table entry
+		.db	$00, $07, $0e, $09, $6d, $6a, $63, $64, $db, $dc, $d5, $d2, $b6, $b1, $b8, $bf
+		.db	$b7, $b0, $b9, $be, $da, $dd, $d4, $d3, $6c, $6b, $62, $65, $01, $06, $0f, $08
+		.db	$6e, $69, $60, $67, $03, $04, $0d, $0a, $b5, $b2, $bb, $bc, $d8, $df, $d6, $d1
+		.db	$d9, $de, $d7, $d0, $b4, $b3, $ba, $bd, $02, $05, $0c, $0b, $6f, $68, $61, $66
+		.db	$dc, $db, $d2, $d5, $b1, $b6, $bf, $b8, $07, $00, $09, $0e, $6a, $6d, $64, $63
+		.db	$6b, $6c, $65, $62, $06, $01, $08, $0f, $b0, $b7, $be, $b9, $dd, $da, $d3, $d4
+		.db	$b2, $b5, $bc, $bb, $df, $d8, $d1, $d6, $69, $6e, $67, $60, $04, $03, $0a, $0d
+		.db	$05, $02, $0b, $0c, $68, $6f, $66, $61, $de, $d9, $d0, $d7, $b3, $b4, $bd, $ba
+		.db	$b8, $bf, $b6, $b1, $d5, $d2, $db, $dc, $63, $64, $6d, $6a, $0e, $09, $00, $07
+		.db	$0f, $08, $01, $06, $62, $65, $6c, $6b, $d4, $d3, $da, $dd, $b9, $be, $b7, $b0
+		.db	$d6, $d1, $d8, $df, $bb, $bc, $b5, $b2, $0d, $0a, $03, $04, $60, $67, $6e, $69
+		.db	$61, $66, $6f, $68, $0c, $0b, $02, $05, $ba, $bd, $b4, $b3, $d7, $d0, $d9, $de
+		.db	$64, $63, $6a, $6d, $09, $0e, $07, $00, $bf, $b8, $b1, $b6, $d2, $d5, $dc, $db
+		.db	$d3, $d4, $dd, $da, $be, $b9, $b0, $b7, $08, $0f, $06, $01, $65, $62, $6b, $6c
+		.db	$0a, $0d, $04, $03, $67, $60, $69, $6e, $d1, $d6, $df, $d8, $bc, $bb, $b2, $b5
+		.db	$bd, $ba, $b3, $b4, $d0, $d7, $de, $d9, $66, $61, $68, $6f, $0b, $0c, $05, $02
+		; byte 3 of each table entry
+		.db	$00, $77, $ee, $99, $07, $70, $e9, $9e, $0e, $79, $e0, $97, $09, $7e, $e7, $90
+		.db	$1d, $6a, $f3, $84, $1a, $6d, $f4, $83, $13, $64, $fd, $8a, $14, $63, $fa, $8d
+		.db	$3b, $4c, $d5, $a2, $3c, $4b, $d2, $a5, $35, $42, $db, $ac, $32, $45, $dc, $ab
+		.db	$26, $51, $c8, $bf, $21, $56, $cf, $b8, $28, $5f, $c6, $b1, $2f, $58, $c1, $b6
+		.db	$76, $01, $98, $ef, $71, $06, $9f, $e8, $78, $0f, $96, $e1, $7f, $08, $91, $e6
+		.db	$6b, $1c, $85, $f2, $6c, $1b, $82, $f5, $65, $12, $8b, $fc, $62, $15, $8c, $fb
+		.db	$4d, $3a, $a3, $d4, $4a, $3d, $a4, $d3, $43, $34, $ad, $da, $44, $33, $aa, $dd
+		.db	$50, $27, $be, $c9, $57, $20, $b9, $ce, $5e, $29, $b0, $c7, $59, $2e, $b7, $c0
+		.db	$ed, $9a, $03, $74, $ea, $9d, $04, $73, $e3, $94, $0d, $7a, $e4, $93, $0a, $7d
+		.db	$f0, $87, $1e, $69, $f7, $80, $19, $6e, $fe, $89, $10, $67, $f9, $8e, $17, $60
+		.db	$d6, $a1, $38, $4f, $d1, $a6, $3f, $48, $d8, $af, $36, $41, $df, $a8, $31, $46
+		.db	$cb, $bc, $25, $52, $cc, $bb, $22, $55, $c5, $b2, $2b, $5c, $c2, $b5, $2c, $5b
+		.db	$9b, $ec, $75, $02, $9c, $eb, $72, $05, $95, $e2, $7b, $0c, $92, $e5, $7c, $0b
+		.db	$86, $f1, $68, $1f, $81, $f6, $6f, $18, $88, $ff, $66, $11, $8f, $f8, $61, $16
+		.db	$a0, $d7, $4e, $39, $a7, $d0, $49, $3e, $ae, $d9, $40, $37, $a9, $de, $47, $30
+		.db	$bd, $ca, $53, $24, $ba, $cd, $54, $23, $b3, $c4, $5d, $2a, $b4, $c3, $5a, $2d
+
+    .data
+crc32result:
+    .d32 0
+crc32count:
+    .d24 0
+crc32outer:
+    .d24 0
+crc32single:
+    .db 0
+
+		END
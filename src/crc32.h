@@ -6,4 +6,6 @@
 void crc32(const char *s, uint24_t length);
 void crc32_initialize(void);
 uint32_t crc32_finalize(void);
+void crc32_suspend(uint32_t *state);
+void crc32_resume(const uint32_t *state);
 #endif //CRC32_H
@@ -2,24 +2,46 @@
 ; Title:		Flash interface
 ; Author:		Jeroen Venema
 ; Created:		16/12/2022
-; Last Updated:	22/04/2025
+; Last Updated:	14/10/2026
 ; 
 ; Modinfo:
 ;	14/10/2023: VDP update routine added
 ;   12/04/2025: Updated for agondev
 ;   22/04/2025: Saving BC/DE/HL registers required in _startVDPupdate
+;   14/10/2026: VDP update streams through BUFFER2, keeping the MOS image in BUFFER1 intact
+;               VDP update routine moved to vdpupdate.c
+;               Row programming through the flash controller registers
+;               CPI based compare and blank check
+;               CPIR search for the next erased byte
+;               Flash programming left out of builds without MOS updates
+
+; The Makefile assembles a build without MOS updates with --defsym FEATURE_MOS=0
+	.ifndef FEATURE_MOS
+FEATURE_MOS	EQU 1
+	.endif
 
-	.global _enableFlashKeyRegister
 	.global _fastmemcpy
+	.global _flashcmp
 	.global _reset
-	.global _startVDPupdate
+	.if FEATURE_MOS
+	.global _enableFlashKeyRegister
+	.global _flashrowcpy
+	.global _flashblank
+	.global _flashfindblank
+	.endif
 
     .assume adl = 1	
     .text
 
-BUFFERSIZE	EQU 1024
-buffer		EQU $50000	; memory location
+FLASH_DATA	EQU $F6
+FLASH_PAGE	EQU $FC
+FLASH_ROW	EQU $FD
+FLASH_COL	EQU $FE
+FLASH_PGCTL	EQU $FF
+ROW_PGM		EQU $04		; FLASH_PGCTL row program enable
+ROWSIZE		EQU 128		; 8 rows per 1KB page
 
+	.if FEATURE_MOS
 _enableFlashKeyRegister:
 	PUSH	IX
 	LD		IX, 0
@@ -34,6 +56,7 @@ _enableFlashKeyRegister:
 	LD		SP, IX
 	POP		IX
 	RET
+	.endif
 	
 _reset:
 	RST	0
@@ -61,97 +84,237 @@ _fastmemcpy:
 	POP     IX
 	RET
 
-_startVDPupdate:
+; uint24_t flashcmp(uint24_t address, uint24_t source, uint24_t size)
+; Compares size bytes at address against source, a byte per LD/INC/CPI.
+; Returns the offset of the first mismatching byte, or size when all bytes match
+_flashcmp:
 	PUSH    IX
 	LD      IX, 0
 	ADD     IX, SP
 
-    PUSH    BC
-    PUSH    DE
-    PUSH    HL
-
-	LD	A, (IX+6)
-	LD	(filehandle), A
-	LD	HL, (IX+9)
-	LD	(filesize), HL
-
-sendstartsequence:
-    LD  A, 23
-    RST.LIL $10
-    LD  A, 0
-    RST.LIL $10
-    LD  A, $A1
-    RST.LIL $10
-    LD  A, 1
-    RST.LIL $10
-
-sendsize:
-	LD	HL, (filesize)
-    LD   A, L
-    RST.LIL $10 ; send LSB
-    LD   A, H
-    RST.LIL $10 ; send middle byte
-    PUSH HL
-    INC  SP
-    POP  AF
-    DEC  SP
-    RST.LIL $10 ; send MSB
-
-senddata_start:
-    LD   A, 0
-    LD   (checksum), A
-
-senddata:
-    LD   A, (filehandle)
-    LD   C, A
-    LD   HL, buffer
-    LD   DE, BUFFERSIZE
-    LD   A, $1A ; mos_fread
-    RST.LIL $08
-    LD   A, D
-    OR   E        ; 0 bytes read?
-    JR   Z, sendchecksum
-
-    LD   HL, buffer
-    PUSH DE
-    POP  BC          ; length of the bufferstream to bc
-    LD   A, 0        ; don't care as bc is set
-    PUSH DE
-    RST.LIL $18
-    POP  DE
-; calculate checksum
-    LD   HL, buffer
+	PUSH    BC
+	PUSH    DE
+
+	LD      BC, (IX+12)	; size
+	LD      HL, 0
+	OR      A, A
+	SBC     HL, BC
+	JR      Z, 2f		; nothing to compare
+	LD      HL, (IX+6)	; address
+	LD      DE, (IX+9)	; source
 1:
-    LD   A, (checksum)
-    ADD  A, (HL)
-    LD   (checksum), A
-    DEC  DE
-    INC  HL
-    LD   A, D ; check if de == 0
-    OR   E
-    JR   NZ, 1b ; more bytes to send
-
-    JR   senddata ; next buffer read from disk
-
-sendchecksum:
-    LD   A, (checksum)
-    NEG ; calculate two's complement
-    RST.LIL $10
-
-    PUSH    HL
-    PUSH    DE
-    PUSH    BC
-
-    LD      A, 0
-	LD		SP, IX
-	POP		IX
+	LD      A, (DE)
+	INC     DE
+	CPI					; A - (HL), HL++, BC--
+	JR      NZ, 3f
+	JP      PE, 1b		; until BC == 0
+2:
+	LD      HL, (IX+12)	; all bytes match
+	JR      4f
+3:
+	DEC     HL			; mismatching byte
+	LD      DE, (IX+6)
+	OR      A, A
+	SBC     HL, DE
+4:
+	POP     DE
+	POP     BC
+
+	LD      SP, IX
+	POP     IX
+	RET
+
+	.if FEATURE_MOS
+; uint24_t flashblank(uint24_t address, uint24_t size)
+; Returns the offset of the first byte that isn't erased (0xFF), or size when all bytes are
+_flashblank:
+	PUSH    IX
+	LD      IX, 0
+	ADD     IX, SP
+
+	PUSH    BC
+	PUSH    DE
+
+	LD      BC, (IX+9)	; size
+	LD      HL, 0
+	OR      A, A
+	SBC     HL, BC
+	JR      Z, 2f		; nothing to check
+	LD      HL, (IX+6)	; address
+	LD      A, $FF
+1:
+	CPI					; A - (HL), HL++, BC--
+	JR      NZ, 3f
+	JP      PE, 1b		; until BC == 0
+2:
+	LD      HL, (IX+9)	; all bytes erased
+	JR      4f
+3:
+	DEC     HL			; first programmed byte
+	LD      DE, (IX+6)
+	OR      A, A
+	SBC     HL, DE
+4:
+	POP     DE
+	POP     BC
+
+	LD      SP, IX
+	POP     IX
+	RET
+
+; uint24_t flashfindblank(uint24_t address, uint24_t size)
+; Returns the offset of the first erased (0xFF) byte, or size when there is none
+_flashfindblank:
+	PUSH    IX
+	LD      IX, 0
+	ADD     IX, SP
+
+	PUSH    BC
+	PUSH    DE
+
+	LD      BC, (IX+9)	; size
+	LD      HL, 0
+	OR      A, A
+	SBC     HL, BC
+	JR      Z, 1f		; nothing to search
+	LD      HL, (IX+6)	; address
+	LD      A, $FF
+	CPIR				; until A == (HL) or BC == 0
+	JR      Z, 2f
+1:
+	LD      HL, (IX+9)	; no erased byte
+	JR      3f
+2:
+	DEC     HL			; first erased byte
+	LD      DE, (IX+6)
+	OR      A, A
+	SBC     HL, DE
+3:
+	POP     DE
+	POP     BC
+
+	LD      SP, IX
+	POP     IX
+	RET
+
+; bool flashrowcpy(uint24_t destination, uint24_t source, uint24_t size)
+; Drop-in for fastmemcpy to flash, using the row programming mode of the flash controller.
+; Each (part of a) row is written with a single OTIRX to FLASH_DATA; the controller
+; increments the column and holds the bus while a byte is programmed.
+; A row program ends by itself after column 127, a partial row is ended by clearing ROW_PGM.
+; Flash needs to be unprotected, with FLASH_FDIV set.
+; Returns false when the controller doesn't finish a row in time
+_flashrowcpy:
+	PUSH    IX
+	LD      IX, 0
+	ADD     IX, SP
+
+	PUSH    BC
+	PUSH    DE
+	PUSH    HL
+
+	LD      HL, (IX+6)
+	LD      (rowdest), HL
+	LD      HL, (IX+9)
+	LD      (rowsrc), HL
+	LD      HL, (IX+12)
+	LD      (rowsize), HL
+
+rowcpy_next:
+	LD      HL, (rowsize)
+	LD      BC, 0
+	OR      A, A
+	SBC     HL, BC
+	JR      Z, rowcpy_done
+
+	; address 0x0PPPPPPP RRRCCCCCCC -> page/row/column registers
+	LD      A, (rowdest+1)
+	SRL     A
+	SRL     A
+	LD      C, A
+	LD      A, (rowdest+2)
+	RRCA
+	RRCA
+	AND     A, $C0
+	OR      A, C
+	OUT0    (FLASH_PAGE), A		; INFO_EN stays cleared
+	LD      A, (rowdest+1)
+	AND     A, 3
+	RLCA
+	LD      C, A
+	LD      A, (rowdest)
+	RLCA
+	AND     A, 1
+	OR      A, C
+	OUT0    (FLASH_ROW), A
+	LD      A, (rowdest)
+	AND     A, ROWSIZE-1
+	OUT0    (FLASH_COL), A
+
+	; bytecount for this row, up to the end of the row
+	LD      C, A
+	LD      A, ROWSIZE
+	SUB     A, C
+	LD      BC, 0
+	LD      C, A
+	LD      HL, (rowsize)
+	OR      A, A
+	SBC     HL, BC
+	JR      NC, 1f
+	ADD     HL, BC				; last part is shorter
+	PUSH    HL
+	POP     BC
+	LD      HL, 0
+1:
+	LD      (rowsize), HL
+	LD      HL, (rowdest)
+	ADD     HL, BC
+	LD      (rowdest), HL
+
+	LD      A, ROW_PGM
+	OUT0    (FLASH_PGCTL), A
+	LD      HL, (rowsrc)
+	LD      DE, FLASH_DATA
+	OTIRX						; (DE) <- (HL), HL++, BC-- until BC == 0
+	LD      (rowsrc), HL
+
+	LD      A, (rowdest)
+	AND     A, ROWSIZE-1
+	JR      Z, 2f				; ended at column 127
+	XOR     A, A
+	OUT0    (FLASH_PGCTL), A	; end partial row
+2:
+	LD      BC, $FFFF			; timeout
+3:
+	IN0     A, (FLASH_PGCTL)
+	AND     A, ROW_PGM
+	JR      Z, rowcpy_next
+	DEC     BC
+	LD      A, B
+	OR      A, C
+	JR      NZ, 3b
+
+	XOR     A, A
+	OUT0    (FLASH_PGCTL), A
+	JR      rowcpy_exit			; A = 0, failed
+
+rowcpy_done:
+	LD      A, 1
+rowcpy_exit:
+	POP     HL
+	POP     DE
+	POP     BC
+
+	LD      SP, IX
+	POP     IX
 	RET
 
     .data
-checksum:
-    .db 0
-filehandle:
-    .db 0
-filesize:
-    .d24 0
+rowdest:
+	.d24 0
+rowsrc:
+	.d24 0
+rowsize:
+	.d24 0
+	.endif
 end
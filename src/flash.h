@@ -1,21 +1,41 @@
 #ifndef FLASH_H
 #define FLASH_H
 
-#define BUFFER1		0x50000
-#define BUFFER2		0x70000
+#define BUFFER1		0x50000		// MOS image
+#define BUFFER2		0x70000		// VDP firmware streaming, compressed MOS blocks
+#define BUFFER2SIZE	0x20000
+#define DRYRUNTARGET	0x90000	// 128KB RAM standing in for the MOS flash, up to this program
 #define FLASHSIZE	0x20000		// 128KB
 
 #define PAGESIZE	1024
 #define FLASHPAGES	128
 #define FLASHSTART	0x0
-#define BLOCKSIZE   16384
+
+#define VDPCHUNKSIZE	0x8000		// VDP firmware is streamed double-buffered in BUFFER2
+#define VDPBUFFER_A		BUFFER2
+#define VDPBUFFER_B		(BUFFER2 + VDPCHUNKSIZE)
+
+// Compressing while sending: one input chunk, two output blocks of a chunk plus header, hash table
+#define VDPLZ4_IN			BUFFER2
+#define VDPLZ4_OUT_A		(BUFFER2 + 0x08000)
+#define VDPLZ4_OUT_B		(BUFFER2 + 0x10100)
+#define VDPLZ4_HASHTABLE	(BUFFER2 + 0x18200)
+
+// Chunked transfers: the frames in flight, until acknowledged, and one input chunk; hash table as above
+#define VDPCHUNK_SLOTS		BUFFER2
+#define VDPCHUNK_SLOTSIZE	0x1100
+#define VDPCHUNK_IN			(BUFFER2 + 0x08000)
 
 #include <stdint.h>
+#include <stdbool.h>
 
 extern void enableFlashKeyRegister(void);
 extern void lockFlashKeyRegister(void);
 extern void fastmemcpy(uint24_t destination, uint24_t source, uint24_t size);
+extern bool flashrowcpy(uint24_t destination, uint24_t source, uint24_t size);
+extern uint24_t flashcmp(uint24_t address, uint24_t source, uint24_t size);
+extern uint24_t flashblank(uint24_t address, uint24_t size);
+extern uint24_t flashfindblank(uint24_t address, uint24_t size);
 extern void reset(void);
-extern void startVDPupdate(uint8_t filehandle, uint24_t filesize);
 
 #endif //FLASH_H
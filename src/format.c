@@ -0,0 +1,104 @@
+/*
+ * Title:			Message formatting
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include "format.h"
+
+#if SLIM
+
+// Writes the digits of value backwards from end, returns the first digit
+static char *formatNumber(char *end, uint32_t value, uint8_t base, bool upper) {
+	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+	*end = 0;
+	do {
+		*--end = digits[value % base];
+		value /= base;
+	} while(value);
+	return end;
+}
+
+int sformat(char *buffer, const char *format, ...) {
+	va_list args;
+	char *out = buffer;
+	char number[12];
+	const char *str;
+	char *digit;
+	uint32_t value;
+	int32_t svalue;
+	uint8_t width, length;
+	bool left, zero, islong;
+	char c;
+
+	va_start(args, format);
+	while((c = *format++)) {
+		if(c != '%') {
+			*out++ = c;
+			continue;
+		}
+		left = (*format == '-');
+		if(left) format++;
+		zero = (*format == '0');
+		if(zero) format++;
+		width = 0;
+		while((*format >= '0') && (*format <= '9')) width = (width * 10) + (*format++ - '0');
+		islong = (*format == 'l');
+		if(islong) format++;
+		c = *format++;
+		switch(c) {
+			case 's':
+				str = va_arg(args, const char *);
+				break;
+			case 'c':
+				number[0] = va_arg(args, int);
+				number[1] = 0;
+				str = number;
+				break;
+			case 'd':
+				svalue = islong ? va_arg(args, int32_t) : va_arg(args, int);
+				value = (svalue < 0) ? -svalue : svalue;
+				digit = formatNumber(number + sizeof(number) - 1, value, 10, false);
+				if(svalue < 0) {
+					if(zero && width) {
+						*out++ = '-'; // sign ahead of the padding
+						width--;
+					}
+					else *--digit = '-';
+				}
+				str = digit;
+				break;
+			case 'u':
+			case 'x':
+			case 'X':
+				value = islong ? va_arg(args, uint32_t) : va_arg(args, unsigned int);
+				str = formatNumber(number + sizeof(number) - 1, value, (c == 'u') ? 10 : 16, c == 'X');
+				break;
+			case 0:
+				format--; // trailing '%'
+				continue;
+			default:
+				*out++ = c;
+				continue;
+		}
+		length = strlen(str);
+		if(!left) {
+			for(; width > length; width--) *out++ = zero ? '0' : ' ';
+		}
+		while(*str) *out++ = *str++;
+		for(; width > length; width--) *out++ = ' ';
+	}
+	va_end(args);
+	*out = 0;
+	return out - buffer;
+}
+
+#endif
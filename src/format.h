@@ -0,0 +1,24 @@
+/*
+ * Title:			Message formatting
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "variant.h"
+
+// A slim build formats its messages without stdio, supporting only what this utility uses:
+// %s %c %d %u %x %X, with a '-' or '0' flag, a width and the 'l' modifier
+#if SLIM
+int sformat(char *buffer, const char *format, ...);
+#else
+#include <stdio.h>
+#define sformat sprintf
+#endif
+
+#endif //FORMAT_H
@@ -0,0 +1,226 @@
+/*
+ * Title:			LZ4 frame decompression
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ *
+ * Modinfo:
+ * 14/10/2026:		Initial version, streaming block by block from the source
+ *                  Greedy block compression, for streaming to the VDP
+ *                  Decompression only in builds with MOS updates, compression with VDP updates
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "variant.h"
+#include "lz4.h"
+
+#define LZ4_FLG_VERSION		0xC0
+#define LZ4_FLG_VERSION01	0x40
+#define LZ4_FLG_BCHECKSUM	0x10
+#define LZ4_FLG_CONTENTSIZE	0x08
+#define LZ4_FLG_DICTID		0x01
+#define LZ4_BLOCK_RAW		0x80	// high bit of the block size; block is stored uncompressed
+#define LZ4_MINMATCH		4
+#define LZ4_LASTLITERALS	5	// a block always ends with at least this many literals
+#define LZ4_MFLIMIT			12	// no match can start within this many bytes from the end of a block
+
+static const uint8_t lz4_magic[LZ4_MAGICLENGTH] = {0x04, 0x22, 0x4D, 0x18};
+
+bool lz4_isframe(const uint8_t *start) {
+	return (memcmp(start, lz4_magic, LZ4_MAGICLENGTH) == 0);
+}
+
+#if FEATURE_MOS
+static bool lz4_readall(lz4_read_t read, void *buffer, uint24_t length) {
+	return (read(buffer, length) == length);
+}
+
+// Decompresses a single block to *dstptr, which may be preceded by earlier output in the same frame.
+// Matches may reach back into earlier blocks, so linked blocks are supported as well
+static uint8_t lz4_block(const uint8_t *src, uint24_t srcsize, uint8_t **dstptr, const uint8_t *dststart, const uint8_t *dstend) {
+	const uint8_t *srcend = src + srcsize;
+	uint8_t *dst = *dstptr;
+	const uint8_t *match;
+	uint24_t length, offset;
+	uint8_t token, b;
+
+	while(src < srcend) {
+		token = *src++;
+
+		// Literals
+		length = token >> 4;
+		if(length == 15) {
+			do {
+				if(src >= srcend) return LZ4_INVALID;
+				b = *src++;
+				length += b;
+			} while(b == 255);
+		}
+		if(length > (uint24_t)(srcend - src)) return LZ4_INVALID;
+		if(length > (uint24_t)(dstend - dst)) return LZ4_TOOLARGE;
+		memcpy(dst, src, length);
+		dst += length;
+		src += length;
+		if(src == srcend) break; // last sequence has no match
+
+		// Match
+		if((srcend - src) < 2) return LZ4_INVALID;
+		offset = src[0] | (src[1] << 8);
+		src += 2;
+		if((offset == 0) || (offset > (uint24_t)(dst - dststart))) return LZ4_INVALID;
+		length = token & 0x0F;
+		if(length == 15) {
+			do {
+				if(src >= srcend) return LZ4_INVALID;
+				b = *src++;
+				length += b;
+			} while(b == 255);
+		}
+		length += LZ4_MINMATCH;
+		if(length > (uint24_t)(dstend - dst)) return LZ4_TOOLARGE;
+		match = dst - offset;
+		if(offset >= length) {
+			memcpy(dst, match, length);
+			dst += length;
+		}
+		else {
+			// Overlapping match repeats the last offset bytes
+			while(length--) *dst++ = *match++;
+		}
+	}
+	*dstptr = dst;
+	return LZ4_OK;
+}
+
+// Decompresses an LZ4 frame from the read source to destination.
+// Compressed blocks are read to the scratch buffer first, raw blocks go straight to the destination.
+// Block and content checksums are skipped; the caller checks the result with its own CRC32
+uint8_t lz4_decompress(lz4_read_t read, uint8_t *destination, uint24_t destsize, uint8_t *scratch, uint24_t scratchsize, uint24_t *size) {
+	uint8_t header[LZ4_MAGICLENGTH + 2];
+	uint8_t skip[8];
+	uint8_t *dst = destination;
+	uint8_t *dstend = destination + destsize;
+	uint32_t blocksize;
+	uint8_t flg, status;
+
+	*size = 0;
+	if(!lz4_readall(read, header, sizeof(header))) return LZ4_INVALID;
+	if(!lz4_isframe(header)) return LZ4_INVALID;
+	flg = header[LZ4_MAGICLENGTH];
+	if(((flg & LZ4_FLG_VERSION) != LZ4_FLG_VERSION01) || (flg & LZ4_FLG_DICTID)) return LZ4_INVALID;
+	if(flg & LZ4_FLG_CONTENTSIZE) {
+		if(!lz4_readall(read, skip, 8)) return LZ4_INVALID;
+	}
+	if(!lz4_readall(read, skip, 1)) return LZ4_INVALID; // header checksum
+
+	while(true) {
+		if(!lz4_readall(read, skip, 4)) return LZ4_INVALID;
+		blocksize = skip[0] | ((uint32_t)skip[1] << 8) | ((uint32_t)skip[2] << 16) | ((uint32_t)skip[3] << 24);
+		if(blocksize == 0) break; // end mark
+
+		if(skip[3] & LZ4_BLOCK_RAW) {
+			blocksize &= 0x7FFFFFFF;
+			if(blocksize > (uint32_t)(dstend - dst)) return LZ4_TOOLARGE;
+			if(!lz4_readall(read, dst, blocksize)) return LZ4_INVALID;
+			dst += blocksize;
+		}
+		else {
+			if(blocksize > scratchsize) return LZ4_BLOCKSIZE;
+			if(!lz4_readall(read, scratch, blocksize)) return LZ4_INVALID;
+			status = lz4_block(scratch, blocksize, &dst, destination, dstend);
+			if(status != LZ4_OK) return status;
+		}
+		if(flg & LZ4_FLG_BCHECKSUM) {
+			if(!lz4_readall(read, skip, 4)) return LZ4_INVALID;
+		}
+	}
+	*size = dst - destination;
+	return LZ4_OK;
+}
+#endif
+
+#if FEATURE_VDP
+static uint16_t lz4_hash(const uint8_t *p) {
+	return ((p[0] << 4) ^ (p[1] << 2) ^ p[2] ^ (p[3] << 6)) & (LZ4_HASHSIZE - 1);
+}
+
+static uint8_t *lz4_length(uint8_t *dst, uint24_t length) {
+	while(length >= 255) {
+		*dst++ = 255;
+		length -= 255;
+	}
+	*dst++ = length;
+	return dst;
+}
+
+// Compresses a single independent block, of at most 64KB, using a single-probe hash table.
+// Returns the compressed size, or 0 when the block doesn't get smaller than the source;
+// destination needs room for size bytes
+uint24_t lz4_compressblock(const uint8_t *source, uint24_t size, uint8_t *destination, uint16_t *hashtable) {
+	const uint8_t *src = source;
+	const uint8_t *srcend = source + size;
+	const uint8_t *matchlimit = srcend - LZ4_LASTLITERALS;
+	const uint8_t *anchor = source;
+	const uint8_t *match;
+	uint8_t *dst = destination;
+	uint8_t *dstend = destination + size;
+	uint8_t *token;
+	uint24_t literals, length;
+	uint16_t h;
+
+	memset(hashtable, 0xFF, LZ4_HASHSIZE * sizeof(uint16_t));
+
+	if(size > LZ4_MFLIMIT) {
+		while(src < (srcend - LZ4_MFLIMIT)) {
+			h = lz4_hash(src);
+			match = source + hashtable[h];
+			hashtable[h] = src - source;
+			if((match >= src) || (memcmp(match, src, LZ4_MINMATCH) != 0)) {
+				src++;
+				continue;
+			}
+			// Extend the match forward; the match always precedes src
+			length = LZ4_MINMATCH;
+			while(((src + length) < matchlimit) && (match[length] == src[length])) length++;
+
+			// Worst case output for this sequence: token, literal length bytes, literals, offset, match length bytes
+			literals = src - anchor;
+			if((dst + 1 + (literals / 255) + 1 + literals + 2 + (length / 255) + 1) > dstend) return 0;
+
+			token = dst++;
+			if(literals >= 15) {
+				*token = 15 << 4;
+				dst = lz4_length(dst, literals - 15);
+			}
+			else *token = literals << 4;
+			memcpy(dst, anchor, literals);
+			dst += literals;
+
+			*dst++ = (src - match) & 0xFF;
+			*dst++ = ((src - match) >> 8) & 0xFF;
+			length -= LZ4_MINMATCH;
+			if(length >= 15) {
+				*token |= 15;
+				dst = lz4_length(dst, length - 15);
+			}
+			else *token |= length;
+
+			src += length + LZ4_MINMATCH;
+			anchor = src;
+		}
+	}
+
+	// Last literals
+	literals = srcend - anchor;
+	if((dst + 1 + (literals / 255) + 1 + literals) >= dstend) return 0;
+	if(literals >= 15) {
+		*dst++ = 15 << 4;
+		dst = lz4_length(dst, literals - 15);
+	}
+	else *dst++ = literals << 4;
+	memcpy(dst, anchor, literals);
+	dst += literals;
+	return dst - destination;
+}
+#endif
@@ -0,0 +1,32 @@
+/*
+ * Title:			LZ4 frame decompression
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ *
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ *                  Block compression, for streaming to the VDP
+ */
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LZ4_MAGICLENGTH	4
+#define LZ4_HASHSIZE	4096	// entries in the compression hash table
+
+#define LZ4_OK			0
+#define LZ4_INVALID		1	// not a supported LZ4 frame, or a corrupt one
+#define LZ4_TOOLARGE	2	// decompressed image doesn't fit the destination
+#define LZ4_BLOCKSIZE	3	// compressed block doesn't fit the scratch buffer
+
+// Reads up to length bytes from the compressed source, returns the number of bytes read
+typedef uint24_t (*lz4_read_t)(void *buffer, uint24_t length);
+
+bool lz4_isframe(const uint8_t *start);
+uint8_t lz4_decompress(lz4_read_t read, uint8_t *destination, uint24_t destsize, uint8_t *scratch, uint24_t scratchsize, uint24_t *size);
+uint24_t lz4_compressblock(const uint8_t *source, uint24_t size, uint8_t *destination, uint16_t *hashtable);
+
+#endif //LZ4_H
@@ -2,7 +2,7 @@
  * Title:			Agon firmware upgrade utility
  * Author:			Jeroen Venema
  * Created:			17/12/2022
- * Last Updated:	13/04/2025
+ * Last Updated:	14/10/2026
  * 
  * Modinfo:
  * 17/12/2022:		Initial version
@@ -14,15 +14,47 @@
  * 13/04/2025:      Ported to agondev
  * 22/04/2025:      echoVDP now asks for screen dimensions specifically
  *                  Added DEBUG options to debug updating VDP
+ * 14/10/2026:      Added diff mode, only erasing/programming changed MOS flash pages
+ *                  MOS image read only once, kept in BUFFER1 from the CRC pass
+ *                  Double-buffered VDP firmware streaming
+ *                  VDP CRC32 calculated during the transfer, no pre-pass with -f/batch
+ *                  Faster crc32 kernel, bench command
+ *                  Erase planner, skipping blank pages and using mass erase where possible
+ *                  Row programming, falling back to byte programming
+ *                  Per-phase timing summary
+ *                  OTA probe polls for VDP replies instead of fixed delays
+ *                  VDP reboot wait with timeout and backoff, instead of fixed 150ms echoes
+ *                  LZ4 compressed MOS images, decompressed to BUFFER1
+ *                  Compressed VDP updates, when the VDP advertises support
+ *                  Sidecar .crc files with the expected CRC32 and size, skipping the VDP pre-pass
+ *                  MOS flash left alone when it already holds the image
+ *                  VDP transfer skipped when the VDP already runs the same firmware
+ *                  Files read with the MOS file API in large blocks, without stdio buffering
+ *                  Console output buffered and sent from the UART0 interrupt, rate-limited progress
+ *                  bench measures fastmemcpy, UART0 throughput and VDP poll latency as well
+ *                  Dry run, flashing MOS to RAM and sending the VDP firmware to a byte counting sink
+ *                  FDIV and verify wait states calculated from the measured system clock
+ *                  Each page verified after programming, re-erased and re-programmed on its own
+ *                  Flash compares and blank checks with a CPI kernel
+ *                  MOS flashed while the VDP programs its own flash and reboots
+ *                  Batch status and heartbeat on PortC, beeps queued instead of delaying the run
+ *                  Chunked, acknowledged VDP updates, when the VDP advertises support
+ *                  Runs of 0xFF left unprogrammed, sparse MOS images
+ *                  Firmware images from SD card files, or streamed by a host over UART1
+ *                  Background duties as cooperative tasks, ESC aborts before the VDP/MOS update
+ *                  Slim build without stdio formatting, MOS-only and VDP-only builds
  */
 
 // DEBUG if set to 1:
 // - PortC bit position 0 upon entry to vdp_update
-// - PortC bit position 1 will flash during echoVDP, to show activity while the VDP isn't responding
+// - PortC bit position 1 will flash during each echoVDP, to show activity while the VDP isn't responding
 #define DEBUG 0
 
 #include "ez80f92.h"
+#include "variant.h"
+#if !SLIM
 #include <stdio.h>
+#endif
 #include <errno.h>
 #include <ctype.h>
 #include <mos_api.h>
@@ -31,14 +63,52 @@
 #include "crc32.h"
 #include <stdint.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include "filesize.h"
+#include "vdpupdate.h"
+#include "phases.h"
+#include "lz4.h"
+#include "sdread.h"
+#include "source.h"
+#include "uart.h"
+#include "status.h"
+#include "tasks.h"
+#include "format.h"
 
 #define UNLOCKMATCHLENGTH 9
+#define UNLOCKTEXTOFFSET	8	// "unlocked!" position, relative to the cursor before unlocking
+#define VDPIDENTITYLENGTH	8	// bytes of the app ELF SHA256, printed by the VDP as hex
 #define EXIT_FILENOTFOUND	4
 #define EXIT_INVALIDPARAMETER	19
 #define DEFAULT_MOSFIRMWARE	"MOS.bin"
 #define DEFAULT_VDPFIRMWARE	"firmware.bin"
+#define MASSERASE_PAGES		20	// from this many page erases, a single mass erase is used instead
+#define PAGE_RETRIES		2	// times a page is re-erased and re-programmed when it doesn't verify
+#define SPARSE_MINRUN		16	// shortest run of 0xFF bytes left unprogrammed
+
+// vpd_pflags bits, set by MOS when the VDP replies
+#define VDPP_FLAG_CURSOR	0x01
+#define VDPP_FLAG_SCRCHAR	0x02
+#define VDPREPLY_TIMEOUT	250	// ms
+#define VDPPROBE_TIMEOUT	50	// ms, first request to a VDP that may not set reply flags at all
+#define VDPREBOOT_TIMEOUT	120000	// ms
+#define VDPPOLL_FIRST		20	// ms between re-polls at first, doubling up to VDPPOLL_MAX
+#define VDPPOLL_MAX			640
+#define VDPREBOOT_ECHO		0x5A	// general poll value, recognized in the reply read directly from UART0
+#define PROGRESS_INTERVAL	100		// ms between progress updates in loops
+#define BEEP_INTERVAL		250		// ms between queued beeps
+#define BEEP_GROUPGAP		1000	// ms ahead of the next group of beeps
+#define ESCAPE_INTERVAL		50		// ms between ESC key checks
+#define BENCH_UARTBYTES		16384	// NUL bytes sent to the VDP, which ignores them
+#define BENCH_VDPPOLLS		16
+#define FLASH_TACC_NS		60		// internal flash read access time
+#define SYSCLK_MIN			(SYSCLK_NOMINAL - (SYSCLK_NOMINAL / 4))	// measurements outside of these are ignored
+#define SYSCLK_MAX			(SYSCLK_NOMINAL + (SYSCLK_NOMINAL / 4))
+
+#if SLIM
+#define getch()				mos_getkey()	// stdio isn't linked in a slim build
+#endif
 
 #define CMDUNKNOWN	0
 #define CMDALL		1
@@ -46,31 +116,95 @@
 #define CMDVDP		3
 #define CMDFORCE	4
 #define CMDBATCH	5
+#define CMDDIFF		6
+#define CMDBENCH	7
+#define CMDBLOCK	8
+#define CMDDRYRUN	9
 
 int errno; // needed by standard library
 
+#if FEATURE_MOS
 bool		flashmos = false;
-char		mosfilename[256];
-FILE*       mosfilehandle;
+#else
+#define		flashmos false			// left out of this build
+#endif
+const char	*mosfilename;			// points to the command line, or the default
+uint8_t		mosfilehandle;
 uint32_t	moscrc;
+uint24_t	mossize;				// size of the MOS image loaded in BUFFER1
+bool		moscompressed = false;	// MOS file is an LZ4 frame, checked after decompression
+bool		mossparse = false;		// MOS file only holds the ranges that aren't 0xFF
+#if FEATURE_VDP
 bool		flashvdp = false;
-char		vdpfilename[256];
-FILE*       vdpfilehandle;
-uint32_t	vdpcrc;
+#else
+#define		flashvdp false
+#endif
+const char	*vdpfilename;
+uint8_t		vdpfilehandle;
+uint32_t	vdpcrc;					// calculated in the pre-pass, 0 when skipped
+uint32_t	vdpstreamcrc;			// calculated during the transfer to the VDP
+bool		vdpcompressed = false;	// VDP file is an LZ4 frame
+bool		mosknown = false;		// expected CRC32/size given in a .crc file
+uint32_t	mosknowncrc;
+uint24_t	mosknownsize;
+bool		vdpknown = false;
+uint32_t	vdpknowncrc;
+uint24_t	vdpknownsize;
+bool		vdplz4 = false;			// VDP accepts compressed updates
+bool		vdpidentify = false;	// VDP reports the identity of its running firmware
+bool		vdpchunked = false;		// VDP accepts chunked, acknowledged updates
+bool		vdpunchanged = false;	// VDP already runs the firmware, nothing sent
+bool		vdpidentityknown = false;
+uint8_t		vdpidentity[VDPIDENTITYLENGTH];	// from the app descriptor in the firmware file
+bool		vdpupdated = false;
+bool		vdpoffline = false;		// VDP reboots while MOS is flashed, console output goes nowhere
+bool		vdplost = false;		// VDP didn't return after the update
+bool		abortable = true;		// no VDP/MOS update started yet, ESC abandons the run
+bool		aborted = false;
+uint8_t		lastkeycount;
+uint8_t		beepspending = 0;
+bool		beeped = false;
+bool		beepgroup = false;		// next beep starts a group
+uint32_t	lastbeep;
 bool		optbatch = false;
 bool		optforce = false;		// No y/n user input required
+bool		optdiff = false;		// Only erase/program MOS flash pages that changed
+#if FEATURE_BENCH
+bool		optbench = false;		// Measure only, don't flash anything
+const char	*benchfilename = DEFAULT_MOSFIRMWARE;	// file to measure SD reads with
+#else
+#define		optbench false
+#endif
+bool		rowprogramming = true;	// cleared after the first row programming failure
+uint24_t	skippedbytes;			// erased bytes left unprogrammed
+bool		mosunchanged = false;	// flash already held the MOS image, nothing erased/programmed
+bool		optdryrun = false;		// MOS flashed to RAM, VDP firmware sent nowhere
+uint24_t	flashtarget = FLASHSTART;	// MOS flash, or its stand-in in RAM with a dry run
+uint32_t	sysclock = SYSCLK_NOMINAL;
+uint8_t		flashfdiv;
+uint8_t		savedfdiv;
 
 char        message[256];
 
 // separate putch function that doesn't rely on a running MOS firmware
 // UART0 initialization done by MOS firmware previously
 // This utility doesn't run without MOS to load it anyway
+// Output is buffered and sent from the UART0 transmit interrupt, or sent directly while interrupts are disabled
 int putch(int c) {
-	while((IO(UART0_LSR) & 0x40) == 0);
-	IO(UART0_THR) = c;
+	if(vdpoffline) return c; // would be lost while the VDP reboots
+	uart0_putch(c);
 	return c;
 }
 
+// Returns true when a progress update is due, at most once every PROGRESS_INTERVAL
+bool progressDue(uint32_t *last) {
+	uint32_t now = timer_ticks();
+
+	if((now - *last) < (PROGRESS_INTERVAL * TIMER_TICKS_PER_MS)) return false;
+	*last = now;
+	return true;
+}
+
 void outstring(const char *str) {
     while(*str) {
         putch(*str);
@@ -78,13 +212,63 @@ void outstring(const char *str) {
     }
 }
 
+// Task sending the next queued beep when due.
+// Tasks don't run during a VDP transfer, where a beep would end up in the stream
+void beepStep(void) {
+	uint32_t now, interval;
+
+	if(beepspending == 0) return;
+	now = timer_ticks();
+	interval = beepgroup ? BEEP_GROUPGAP : BEEP_INTERVAL;
+	if(beeped && ((now - lastbeep) < (interval * TIMER_TICKS_PER_MS))) return;
+	putch(7);
+	lastbeep = now;
+	beeped = true;
+	beepgroup = false;
+	beepspending--;
+}
+
+void beepdrain(void) {
+	while(beepspending) tasks_run();
+}
+
+// Beeps are queued and sent by beepStep(), so they don't hold up the run.
+// A group still being sent is finished first, the new group follows BEEP_GROUPGAP later
 void beep(unsigned int number) {
-	while(number--) {
-		putch(7);
-		delayms(250);
-	}
+	beepdrain();
+	beepspending = number;
+	beepgroup = true;
+	tasks_run();
+}
+
+// Task noting an ESC key press, as long as the run can still be abandoned
+void escapeStep(void) {
+	volatile SYSVAR *sysvars = (volatile SYSVAR *)mos_sysvars();
+
+	if(!abortable || (sysvars->vkeycount == lastkeycount)) return;
+	lastkeycount = sysvars->vkeycount;
+	if((sysvars->keyascii == 0x1B) && sysvars->vkeydown) aborted = true;
+}
+
+// Forget key presses so far, e.g. the ESC answering a prompt
+void escapeReset(void) {
+	volatile SYSVAR *sysvars = (volatile SYSVAR *)mos_sysvars();
+
+	lastkeycount = sysvars->vkeycount;
+}
+
+// Past this point, the run can't be abandoned anymore
+void pointOfNoReturn(void) {
+	abortable = false;
 }
 
+// Runs the tasks, returns true when ESC was pressed
+bool userAborted(void) {
+	tasks_run();
+	return aborted;
+}
+
+#if FEATURE_VDP || FEATURE_BENCH
 uint8_t getCharAt(uint16_t x, uint16_t y) {
 	delayms(20);
 	putch(23);
@@ -98,22 +282,133 @@ uint8_t getCharAt(uint16_t x, uint16_t y) {
     return getsysvar_scrchar();
 }
 
+void clearVDPflag(uint8_t flag) {
+	volatile SYSVAR *sysvars = (volatile SYSVAR *)mos_sysvars();
+	bool enabled;
+
+	enabled = uart0_irqoff(); // MOS sets flags from the UART0 interrupt
+	sysvars->vpd_pflags &= ~flag;
+	uart0_irqrestore(enabled);
+}
+
+// Polls for the VDP reply flag, returns false after timeoutms
+bool waitVDPflag(uint8_t flag, uint24_t timeoutms) {
+	volatile SYSVAR *sysvars = (volatile SYSVAR *)mos_sysvars();
+	uint32_t start = timer_ticks();
+
+	while(!(sysvars->vpd_pflags & flag)) {
+		if((timer_ticks() - start) > ((uint32_t)timeoutms * TIMER_TICKS_PER_MS)) return false;
+	}
+	return true;
+}
+
+bool readCursor(uint8_t *x, uint8_t *y, uint24_t timeoutms) {
+	volatile SYSVAR *sysvars = (volatile SYSVAR *)mos_sysvars();
+
+	clearVDPflag(VDPP_FLAG_CURSOR);
+	putch(23);
+	putch(0);
+	putch(0x82);
+	if(!waitVDPflag(VDPP_FLAG_CURSOR, timeoutms)) return false;
+	*x = sysvars->cursorX;
+	*y = sysvars->cursorY;
+	return true;
+}
+
+bool readCharAt(uint16_t x, uint16_t y, char *c) {
+	volatile SYSVAR *sysvars = (volatile SYSVAR *)mos_sysvars();
+
+	clearVDPflag(VDPP_FLAG_SCRCHAR);
+	putch(23);
+	putch(0);
+	putch(131);
+	putch(x & 0xFF);
+	putch((x >> 8) & 0xFF);
+	putch(y & 0xFF);
+	putch((y >> 8) & 0xFF);
+	if(!waitVDPflag(VDPP_FLAG_SCRCHAR, VDPREPLY_TIMEOUT)) return false;
+	*c = sysvars->scrchar;
+	return true;
+}
+#endif
+
+#if FEATURE_VDP
+// Unlocks the OTA updater in the VDP, and notes the capabilities it advertises after "unlocked!"
 bool vdp_ota_present(void) {
-	char test[UNLOCKMATCHLENGTH];
+	uint8_t status[VDPSTATUS_LENGTH];
+	char test[UNLOCKMATCHLENGTH+VDPCAPS];
+	const char *caps;
+	uint8_t x, y;
 	uint16_t n;
+	bool flags, packet = false;
+
+	// The VDP prints the unlock acknowledgement relative to the current cursor.
+	// A VDP that doesn't reply within VDPPROBE_TIMEOUT sets no reply flags, and sends no status packet either
+	flags = readCursor(&x, &y, VDPPROBE_TIMEOUT);
 
+	if(flags) uart0_rxcapture(true);
 	putch(23);
 	putch(0);
 	putch(0xA1);
-	putch(0);
+	putch(VDPOTA_UNLOCK);
 	outstring("unlock");
+	if(flags) {
+		packet = vdpupdate_status(status, VDPREPLY_TIMEOUT);
+		uart0_rxcapture(false);
+	}
+
+	if(packet) {
+		// A single reply with the unlock state and the capabilities
+		if(!status[0]) return false;
+		caps = (const char *)status + 1;
+	}
+	else {
+		if(flags) {
+			// The VDP handles requests in order, so the replies come after the acknowledgement
+			for(n = 0; flags && (n < UNLOCKMATCHLENGTH+VDPCAPS); n++) {
+				flags = readCharAt(x + UNLOCKTEXTOFFSET + n, y, &test[n]);
+			}
+			if(!flags) return false;
+		}
+		else {
+			// No reply flags from this VDP/MOS, use fixed delays. Such a VDP advertises no capabilities
+			for(n = 0; n < UNLOCKMATCHLENGTH; n++) test[n] = getCharAt(n+8, 3);
+			// 3 - line on-screen
+			memset(test + UNLOCKMATCHLENGTH, 0, VDPCAPS);
+		}
+		if(memcmp(test, "unlocked!",UNLOCKMATCHLENGTH) != 0) return false;
+		caps = test + UNLOCKMATCHLENGTH;
+	}
+	vdplz4 = (memchr(caps, VDPCAP_LZ4, VDPCAPS) != NULL);
+	vdpidentify = (memchr(caps, VDPCAP_IDENTITY, VDPCAPS) != NULL);
+	vdpchunked = (memchr(caps, VDPCAP_CHUNKED, VDPCAPS) != NULL);
+	return true;
+}
+
+// Asks the unlocked OTA updater for the identity of the running firmware, which it prints
+// at the cursor as the first VDPIDENTITYLENGTH bytes of its app ELF SHA256 in hex.
+// Returns true when it matches the firmware file
+bool vdpRunsFirmware(void) {
+	char hex[3];
+	char c;
+	uint8_t x, y;
+	uint8_t n;
 
-	for(n = 0; n < UNLOCKMATCHLENGTH+1; n++) test[n] = getCharAt(n+8, 3);
-	// 3 - line on-screen
-	if(memcmp(test, "unlocked!",UNLOCKMATCHLENGTH) == 0) return true;
-	else return false;
+	if(!readCursor(&x, &y, VDPREPLY_TIMEOUT)) return false;
+	putch(23);
+	putch(0);
+	putch(0xA1);
+	putch(VDPOTA_IDENTITY);
+	for(n = 0; n < (VDPIDENTITYLENGTH * 2); n++) {
+		if(!readCharAt(x + n, y, &c)) return false;
+		sformat(hex, "%02x", vdpidentity[n / 2]);
+		if(tolower(c) != hex[n & 1]) return false;
+	}
+	return true;
 }
+#endif
 
+#if FEATURE_MOS
 uint8_t mos_magicnumbers[] = {0xF3, 0xED, 0x7D, 0x5B, 0xC3};
 #define MOS_MAGICLENGTH 5
 bool containsMosHeader(uint8_t *filestart) {
@@ -124,9 +419,23 @@ bool containsMosHeader(uint8_t *filestart) {
 	return match;
 }
 
+// Sparse MOS image: 'AGSP',<24bit image size>, then ranges of <24bit offset>,<24bit length>,<bytes>,
+// ending with a range of length 0. Everything outside the ranges is 0xFF
+uint8_t sparse_magicnumbers[] = {'A', 'G', 'S', 'P'};
+#define SPARSE_MAGICLENGTH	4
+#define SPARSE_HEADER		7
+#define SPARSE_RANGEHEADER	6
+
+bool isSparseImage(const uint8_t *filestart) {
+	return (memcmp(filestart, sparse_magicnumbers, SPARSE_MAGICLENGTH) == 0);
+}
+#endif
+
+#if FEATURE_VDP
 uint8_t esp32_magicnumbers[] = {0x32, 0x54, 0xCD, 0xAB};
 #define ESP32_MAGICLENGTH 4
 #define ESP32_MAGICSTART 0x20
+#define ESP32_SHA256START 0xB0	// app_elf_sha256 in the app descriptor, following the magic
 bool containsESP32Header(uint8_t *filestart) {
 	uint8_t n;
 	bool match = true;
@@ -137,6 +446,7 @@ bool containsESP32Header(uint8_t *filestart) {
 	}
 	return match;
 }
+#endif
 
 void print_version(void) {
 	outstring("Agon firmware update utility v1.9\n\r\n\r");
@@ -144,7 +454,15 @@ void print_version(void) {
 
 void usage(void) {
 	print_version();
-	outstring("Usage: FLASH [all | [mos <filename>] [vdp <filename>] | batch] <-f>\n\r");
+#if FEATURE_MOS && FEATURE_VDP && FEATURE_BENCH
+	outstring("Usage: FLASH [all | [mos <filename>] [vdp <filename>] | batch | bench <filename>] <-f> <-d> <-n> <-b KB>\n\r");
+#elif FEATURE_MOS && FEATURE_VDP
+	outstring("Usage: FLASH [all | [mos <filename>] [vdp <filename>] | batch] <-f> <-d> <-n> <-b KB>\n\r");
+#elif FEATURE_MOS
+	outstring("Usage: FLASH [all | mos <filename> | batch] <-f> <-d> <-n> <-b KB>\n\r");
+#else
+	outstring("Usage: FLASH [all | vdp <filename> | batch] <-f> <-n> <-b KB>\n\r");
+#endif
 }
 
 bool getResponse(void) {
@@ -154,6 +472,7 @@ bool getResponse(void) {
 	while((response != 'y') && (response != 'n')) response = tolower(getch());
 	if(response == 'n') outstring("\r\nUser abort\n\r\n\r");
 	else outstring("\r\n\r\n");
+	escapeReset();
 	return response == 'y';
 }
 
@@ -163,83 +482,367 @@ void askEscapeToContinue(void) {
 	outstring("Press ESC to continue");
 	while(response != 0x1B) response = tolower(getch());
 	outstring("\r\n");
+	escapeReset();
 }
 
+#if FEATURE_VDP
 bool update_vdp(void) {
 	uint24_t filesize;
+	uint8_t mode;
 
 	putch(12); // cls
 	print_version();	
 	outstring("Unlocking VDP updater...\r\n");
 
-	if(!vdp_ota_present()) {
+	phase_begin(PHASE_OTAUNLOCK);
+	if(optdryrun) {
+		// Nothing is sent to the VDP, act like one that accepts compressed updates
+		vdplz4 = true;
+	}
+	else if(!vdp_ota_present()) {
+		phase_end(PHASE_OTAUNLOCK, 0);
 		outstring(" failed - OTA not present in current VDP\r\n\r\n");
 		outstring("Program the VDP using Arduino / PlatformIO / esptool\r\n\r\n");
 		return false;
 	}
+	if(vdpidentify && vdpidentityknown && vdpRunsFirmware()) {
+		phase_end(PHASE_OTAUNLOCK, 0);
+		vdpunchanged = true;
+		return false;
+	}
+	phase_end(PHASE_OTAUNLOCK, 0);
+	if(vdpcompressed && !vdplz4) {
+		outstring(" failed - current VDP doesn't accept compressed firmware\r\n\r\n");
+		outstring("Use an uncompressed firmware file\r\n\r\n");
+		return false;
+	}
+	// A compressed file is sent as-is, chunks are only compressed one by one
+	if(vdpcompressed) mode = VDPUPDATE_LZ4FILE;
+	else if(vdpchunked) mode = vdplz4 ? VDPUPDATE_CHUNKEDLZ4 : VDPUPDATE_CHUNKED;
+	else if(vdplz4) mode = VDPUPDATE_LZ4;
+	else mode = VDPUPDATE_RAW;
 	// Do actual work here
-	outstring("Updating VDP firmware\r\n");
-	filesize = getFileSize(vdpfilehandle->fhandle);	
-	startVDPupdate(vdpfilehandle->fhandle, filesize);
+	if(mode == VDPUPDATE_RAW) outstring("Updating VDP firmware\r\n");
+	else if(mode == VDPUPDATE_CHUNKED) outstring("Updating VDP firmware (chunked)\r\n");
+	else if(mode == VDPUPDATE_CHUNKEDLZ4) outstring("Updating VDP firmware (chunked, compressed)\r\n");
+	else outstring("Updating VDP firmware (compressed)\r\n");
+	if(userAborted()) return false;
+	pointOfNoReturn(); // the VDP stops its current firmware from here
+	filesize = source_size(vdpfilehandle);	
+	vdpupdate_sink(optdryrun);
+	phase_begin(PHASE_VDPTRANSFER);
+	vdpstreamcrc = startVDPupdate(vdpfilehandle, filesize, mode, vdpcrc);
+	phase_end(PHASE_VDPTRANSFER, filesize);
+	if(optdryrun) {
+		sformat(message,"%lu bytes to the VDP, checksum 0x%02X\r\n", vdpupdate_sinkbytes(), vdpupdate_sinksum());
+		outstring(message);
+	}
+	vdpupdated = true;
+	if(vdpupdate_failed() || source_failed(vdpfilehandle)) return false;
+	if(vdpcrc && (vdpcrc != vdpstreamcrc)) return false;
     return true;
 }
 
-bool update_mos(char *filename) {
-	uint32_t crcresult;
-	uint24_t bytesread;
-	char* ptr = (char*)BUFFER1;
+void showVDPresult(void) {
+	if(vdpunchanged) outstring("VDP firmware unchanged\r\n\r\n");
+	if(!vdpupdated) return;
+	sformat(message,"VDP firmware sent, CRC 0x%08lX", vdpstreamcrc);
+	outstring(message);
+	if(vdpcrc && (vdpcrc != vdpstreamcrc)) {
+		sformat(message," - doesn't match expected CRC 0x%08lX, rejected", vdpcrc);
+		outstring(message);
+	}
+	else if(vdpupdate_failed()) outstring(" - transfer failed, rejected");
+	else if(source_failed(vdpfilehandle)) outstring(" - image source stopped responding, transfer failed");
+	if(vdpupdate_resent()) {
+		sformat(message,", %u chunks resent", vdpupdate_resent());
+		outstring(message);
+	}
+	outstring("\r\n\r\n");
+}
+#endif
+
+#if FEATURE_MOS
+// Returns true if the flash page doesn't already hold the given image contents,
+// with all bytes past the end of the image in this page erased (0xFF)
+bool flashPageChanged(uint24_t page, uint24_t imagesize) {
+	uint24_t offset = page * PAGESIZE;
+	uint24_t flash = flashtarget + offset;
+	uint24_t imagebytes;
+
+	if(offset >= imagesize) imagebytes = 0;
+	else if((imagesize - offset) < PAGESIZE) imagebytes = imagesize - offset;
+	else imagebytes = PAGESIZE;
+
+	if(flashcmp(flash, BUFFER1 + offset, imagebytes) != imagebytes) return true;
+	return (flashblank(flash + imagebytes, PAGESIZE - imagebytes) != (PAGESIZE - imagebytes));
+}
+
+bool flashPageBlank(uint24_t page) {
+	return (flashblank(flashtarget + (page * PAGESIZE), PAGESIZE) == PAGESIZE);
+}
+
+// Returns true if the flash already holds the MOS image in BUFFER1, with the rest of the flash erased.
+// BUFFER1 was checked against moscrc while loading, so a direct compare is enough
+bool flashHoldsImage(uint24_t imagesize) {
+	bool match;
+
+	phase_begin(PHASE_VERIFY);
+	match = (flashcmp(flashtarget, BUFFER1, imagesize) == imagesize) &&
+			(flashblank(flashtarget + imagesize, FLASHSIZE - imagesize) == (FLASHSIZE - imagesize));
+	phase_end(PHASE_VERIFY, FLASHSIZE);
+	return match;
+}
+
+// Selects the pages to erase from the pages that need to change, skipping pages that are already blank.
+// Returns true when a mass erase should be used instead, because no page needs to be kept
+bool planFlashErase(const bool *pagechanged, bool *pageerase) {
+	uint24_t page, erasepages = 0, keeppages = 0, blankpages = 0;
+	bool blank;
+
+	for(page = 0; page < FLASHPAGES; page++) {
+		blank = flashPageBlank(page);
+		pageerase[page] = pagechanged[page] && !blank;
+		if(blank) blankpages++;
+		else if(pageerase[page]) erasepages++;
+		else keeppages++;
+	}
+	if((keeppages == 0) && (erasepages >= MASSERASE_PAGES)) {
+		outstring("Erase plan: mass erase\r\n");
+		return true;
+	}
+	sformat(message,"Erase plan: %d page erases, %d pages already blank\r\n", erasepages, blankpages);
+	outstring(message);
+	return false;
+}
+
+// Measures the system clock, falling back to the nominal clock without a running RTC.
+// The flash timing clock needs a period of at least 5.1us: FDIV = Ceiling(clock * 5,1us), 95 at 18.432MHz
+void calibrateFlash(void) {
+	uint32_t measured;
+
+	measured = timer_measureclock();
+	if((measured >= SYSCLK_MIN) && (measured <= SYSCLK_MAX)) sysclock = measured;
+	flashfdiv = ((sysclock * 51) + 9999999) / 10000000;
+	savedfdiv = IO(FLASH_FDIV);
+	sformat(message,"System clock %lu.%03luMHz (%s), FDIV %u\r\n", sysclock / 1000000, (sysclock / 1000) % 1000, (sysclock == measured) ? "measured" : "nominal", flashfdiv);
+	outstring(message);
+}
+
+// Smallest number of wait states covering the flash read access time at the system clock
+uint8_t flashWaitStates(void) {
+	uint24_t cycles;
+
+	cycles = (((sysclock / 1000) * FLASH_TACC_NS) + 999999) / 1000000;
+	return (cycles > 1) ? (cycles - 1) : 0;
+}
+
+void unlockFlash(void) {
+	if(optdryrun) return;
+	enableFlashKeyRegister();	// unlock Flash Key Register, so we can write to the Flash Write/Erase protection registers
+	IO(FLASH_PROT) = 0;				// disable protection on all 8x16KB blocks in the flash
+	enableFlashKeyRegister();	// will need to unlock again after previous write to the flash protection register
+	IO(FLASH_FDIV) = flashfdiv;
+}
+
+void lockFlash(void) {
+	if(optdryrun) return;
+	enableFlashKeyRegister();	// unlock Flash Key Register, so we can write to the Flash Write/Erase protection registers
+	IO(FLASH_FDIV) = savedfdiv;
+	enableFlashKeyRegister();
+	IO(FLASH_PROT) = 0xff;			// enable protection on all 8x16KB blocks in the flash
+}
+
+uint32_t flashCRC32(uint24_t size) {
+	crc32_initialize();
+	crc32((const char *)flashtarget, size);
+	return crc32_finalize();
+}
+
+// Verifies the flash with as few wait states as the system clock allows, and the original setting
+// when that fails. Interrupts are disabled, so no code runs from flash with the reduced setting
+bool verifyFlash(uint24_t size) {
+	uint8_t ctrl = IO(FLASH_CTRL);
+	uint8_t waitstates = flashWaitStates();
+	bool verified;
+
+	if(!optdryrun && (waitstates < (ctrl >> 5))) IO(FLASH_CTRL) = (ctrl & 0x1F) | (waitstates << 5);
+	verified = (flashCRC32(size) == moscrc);
+	if(IO(FLASH_CTRL) != ctrl) {
+		IO(FLASH_CTRL) = ctrl;
+		if(!verified) verified = (flashCRC32(size) == moscrc);
+	}
+	return verified;
+}
+
+void eraseFlash(void) {
+	if(optdryrun) {
+		memset((void *)flashtarget, 0xFF, FLASHSIZE);
+		return;
+	}
+	IO(FLASH_PAGE) = 0;				// INFO_EN bit cleared, leave the information page alone
+	IO(FLASH_PGCTL) = 0x01;			// Mass erase bit enable, start erase
+	while(IO(FLASH_PGCTL) & 0x01);	// wait for completion of erase
+}
+
+void eraseFlashPage(uint24_t page) {
+	if(optdryrun) {
+		memset((void *)(flashtarget + (page * PAGESIZE)), 0xFF, PAGESIZE);
+		return;
+	}
+	IO(FLASH_PAGE) = page;
+	IO(FLASH_PGCTL) = 0x02;			// Page erase bit enable, start erase
+	while(IO(FLASH_PGCTL) & 0x02);  // wait for completion of erase
+}
+
+// Programs a part of a page, using the row programming mode of the flash controller.
+// When a row program doesn't complete, or doesn't verify, the page is programmed byte by byte
+// using fastmemcpy, which is then used for the rest of this run
+void programFlash(uint24_t destination, uint24_t source, uint24_t size) {
+	if(rowprogramming && !optdryrun) {
+		if(flashrowcpy(destination, source, size) && (flashcmp(destination, source, size) == size)) return;
+		rowprogramming = false;
+		outstring(" - row programming failed, programming bytes\r\n");
+	}
+	fastmemcpy(destination, source, size);
+}
+
+// Programs the source to erased flash, leaving out runs of at least SPARSE_MINRUN 0xFF bytes,
+// and any 0xFF bytes at the start and end. Returns the number of bytes left out
+uint24_t programSparse(uint24_t destination, uint24_t source, uint24_t size) {
+	uint24_t offset = 0, start, run;
+	uint24_t skipped = size;
+
+	while(offset < size) {
+		offset += flashblank(source + offset, size - offset);
+		if(offset == size) break;
+		// extend the range up to the next long run of 0xFF, or the end
+		start = offset;
+		while(offset < size) {
+			offset += flashfindblank(source + offset, size - offset);
+			run = flashblank(source + offset, size - offset);
+			if((run >= SPARSE_MINRUN) || ((offset + run) == size)) break;
+			offset += run;
+		}
+		programFlash(destination + start, source + start, offset - start);
+		skipped -= offset - start;
+	}
+	return skipped;
+}
+
+// Programs a page and verifies it against the image, re-erasing and re-programming it when needed.
+// Returns the number of retries, more than PAGE_RETRIES when it still doesn't verify
+uint8_t programPage(uint24_t page, uint24_t destination, uint24_t source, uint24_t size) {
+	uint8_t retry;
+	uint24_t skipped = 0;
+
+	for(retry = 0; retry <= PAGE_RETRIES; retry++) {
+		if(retry) eraseFlashPage(page);
+		skipped = programSparse(destination, source, size);
+		if(flashcmp(destination, source, size) == size) break;
+	}
+	skippedbytes += skipped;
+	return retry;
+}
+
+// Lists the pages that needed retries as <page>(<retries>), to keep track of wear
+void showMarginalPages(const uint8_t *pageretries) {
+	uint24_t page;
+	bool marginal = false;
+
+	for(page = 0; page < FLASHPAGES; page++) {
+		if(pageretries[page] == 0) continue;
+		if(!marginal) outstring("\r\nMarginal pages:");
+		marginal = true;
+		if(pageretries[page] > PAGE_RETRIES) sformat(message," %d(failed)", page+1);
+		else sformat(message," %d(%d)", page+1, pageretries[page]);
+		outstring(message);
+	}
+}
+
+bool update_mos(void) {
+	bool verified;
 	uint24_t counter, pagemax, lastpagebytes;
 	uint24_t addressto,addressfrom;
 	uint24_t filesize;
+	uint24_t changedpages;
+	uint24_t erasedbytes, programmedbytes;
+	uint32_t lastprogress;
+	bool pagechanged[FLASHPAGES];
+	bool pageerase[FLASHPAGES];
+	uint8_t pageretries[FLASHPAGES];
+	uint24_t pagebytes;
+	bool masserase;
 	int attempt;
 	bool success = false;
 
 	putch(12); // cls
 	print_version();	
 	
-	outstring("Programming MOS firmware to ez80 flash...\r\n\r\n");
-	outstring("Reading MOS firmware");
-	filesize = getFileSize(mosfilehandle->fhandle);
-	// Read file to memory
-	crc32_initialize();
-	while((bytesread = fread(ptr, 1, BLOCKSIZE, mosfilehandle)) > 0) {
-		crc32(ptr, bytesread);
-		ptr += bytesread;
-		putch('.');
+#if FEATURE_VDP
+	showVDPresult();
+#endif
+	if(optdryrun) {
+		outstring("Programming MOS firmware to RAM (dry run)...\r\n\r\n");
+		// start from a copy of the live flash, so diff mode and the unchanged check behave the same
+		fastmemcpy(flashtarget, FLASHSTART, FLASHSIZE);
 	}
-	crcresult = crc32_finalize();
-	outstring("\r\n");
-	// Final memory check to given crc32
-	if(crcresult != moscrc) {
-		outstring("Error reading file to memory\r\n");
-		return false;
+	else outstring("Programming MOS firmware to ez80 flash...\r\n\r\n");
+	// The MOS image was read to BUFFER1 and checked during calculateCRC32()
+	filesize = mossize;
+	// Nothing to do when the same MOS is installed already; the live MOS stays untouched
+	if(flashHoldsImage(filesize)) {
+		outstring("MOS firmware unchanged\r\n\r\n");
+		mosunchanged = true;
+		return true;
 	}
-	outstring("\r\n");	
+	calibrateFlash();
+	pointOfNoReturn();
 	// Actual work here	
-    asm volatile("di"); // prohibit any access to the old MOS firmware
+    if(!optdryrun) asm volatile("di"); // prohibit any access to the old MOS firmware
 	attempt = 0;
 	while((!success) && (attempt < 3)) {
 		// start address in flash
-		addressto = FLASHSTART;
+		addressto = flashtarget;
 		addressfrom = BUFFER1;
 		// Write attempt#
 		if(attempt > 0) {
-            sprintf(message,"Retry attempt #%d\r\n", attempt);
+            sformat(message,"Retry attempt #%d\r\n", attempt);
             outstring(message);
         }
+		// Determine which pages need to change
+		phase_begin(PHASE_ERASE);
+		changedpages = 0;
+		for(counter = 0; counter < FLASHPAGES; counter++) {
+			pagechanged[counter] = optdiff ? flashPageChanged(counter, filesize) : true;
+			if(pagechanged[counter]) changedpages++;
+		}
+		if(optdiff) {
+			sformat(message,"%d/%d pages changed\r\n", changedpages, FLASHPAGES);
+			outstring(message);
+		}
+
+		masserase = planFlashErase(pagechanged, pageerase);
+
 		// Unprotect and erase flash
 		outstring("Erasing flash... ");
 
-		enableFlashKeyRegister();	// unlock Flash Key Register, so we can write to the Flash Write/Erase protection registers
-		IO(FLASH_PROT) = 0;				// disable protection on all 8x16KB blocks in the flash
-		enableFlashKeyRegister();	// will need to unlock again after previous write to the flash protection register
-		IO(FLASH_FDIV) = 0x5F;			// Ceiling(18Mhz * 5,1us) = 95, or 0x5F
+		unlockFlash();
 	
-		for(counter = 0; counter < FLASHPAGES; counter++) {
-			IO(FLASH_PAGE) = counter;
-			IO(FLASH_PGCTL) = 0x02;			// Page erase bit enable, start erase
-            while(IO(FLASH_PGCTL) & 0x02);  // wait for completion of erase
+		erasedbytes = 0;
+		if(masserase) {
+			eraseFlash();
+			erasedbytes = FLASHSIZE;
 		}
+		else {
+			for(counter = 0; counter < FLASHPAGES; counter++) {
+				if(!pageerase[counter]) continue;
+				eraseFlashPage(counter);
+				erasedbytes += PAGESIZE;
+				tasks_run();
+			}
+		}
+		phase_end(PHASE_ERASE, erasedbytes);
         outstring("\r\n");
 				
 		// determine number of pages to write
@@ -251,28 +854,43 @@ bool update_mos(char *filename) {
 		else lastpagebytes = PAGESIZE; // normal last page
 		
 		// write out each page to flash
+		phase_begin(PHASE_PROGRAM);
+		programmedbytes = 0;
+		skippedbytes = 0;
+		memset(pageretries, 0, FLASHPAGES);
+		lastprogress = timer_ticks() - (PROGRESS_INTERVAL * TIMER_TICKS_PER_MS);
 		for(counter = 0; counter < pagemax; counter++) {
-			sprintf(message,"\rWriting flash page %03d/%03d", counter+1, pagemax);
-            outstring(message);
+			if(pagechanged[counter]) {
+				// Output is sent directly with interrupts disabled, keep it from slowing down programming
+				if(progressDue(&lastprogress) || (counter == (pagemax - 1))) {
+					sformat(message,"\rWriting flash page %03d/%03d", counter+1, pagemax);
+					outstring(message);
+				}
 
-			if(counter == (pagemax - 1)) // last page to write - might need to write less than PAGESIZE
-				fastmemcpy(addressto,addressfrom,lastpagebytes);				
-			else 
-				fastmemcpy(addressto,addressfrom,PAGESIZE);
-		
+				// last page to write - might need to write less than PAGESIZE
+				pagebytes = (counter == (pagemax - 1)) ? lastpagebytes : PAGESIZE;
+				pageretries[counter] = programPage(counter, addressto, addressfrom, pagebytes);
+				programmedbytes += pagebytes;
+				tasks_run();
+			}
 			addressto += PAGESIZE;
 			addressfrom += PAGESIZE;
 		}
+		phase_end(PHASE_PROGRAM, programmedbytes);
+		if(skippedbytes) {
+			sformat(message,"\r\n%u erased bytes left as-is", skippedbytes);
+			outstring(message);
+		}
+		showMarginalPages(pageretries);
 		// lock the flash before WARM reset
-		enableFlashKeyRegister();	// unlock Flash Key Register, so we can write to the Flash Write/Erase protection registers
-		IO(FLASH_PROT) = 0xff;			// enable protection on all 8x16KB blocks in the flash
+		lockFlash();
 		
 		outstring("\r\nChecking CRC... ");
 
-		crc32_initialize();
-		crc32(FLASHSTART, filesize);
-		crcresult = crc32_finalize();
-		if(crcresult == moscrc) {
+		phase_begin(PHASE_VERIFY);
+		verified = verifyFlash(filesize);
+		phase_end(PHASE_VERIFY, filesize);
+		if(verified) {
 			outstring("OK\r\n");
 			success = true;
 		}
@@ -284,8 +902,12 @@ bool update_mos(char *filename) {
 	outstring("\r\n");
 	return success;
 }
+#endif
 
+#if FEATURE_VDP
 void echoVDP(uint8_t value) {
+	// A rebooting VDP may hold CTS, send regardless so the reboot timeout stays in charge
+	uart0_ctsbypass();
     // Disable flowcontrol
     putch(23);
     putch(0);
@@ -308,10 +930,56 @@ void echoVDP(uint8_t value) {
     putch(23);
     putch(0);
     putch(0x86);
-    // Wait a while before sending the next echo
-    delayms(150);
 }
 
+// General poll reply packet from the VDP: 0x80 | PACKET_GP, length, echoed value
+uint8_t vdp_gpreply[] = {0x80, 0x01, VDPREBOOT_ECHO};
+
+// Reads all bytes received from the VDP directly from UART0, matching them against the
+// general poll reply. Returns true once the complete reply came in
+bool vdpPollReplied(uint8_t *matched) {
+	int c;
+
+	while((c = uart0_getch()) >= 0) {
+		if(c == vdp_gpreply[*matched]) (*matched)++;
+		else *matched = (c == vdp_gpreply[0]) ? 1 : 0;
+		if(*matched == sizeof(vdp_gpreply)) return true;
+	}
+	return false;
+}
+
+// Waits for the VDP to return after rebooting, counting from start. Normally by continuously
+// watching the screen height that MOS stores when the VDP answers. After flashing MOS, with
+// interrupts disabled, (polled) the reply is read from UART0 directly instead.
+// The VDP is re-polled only when it hasn't answered within the current interval, doubling
+// the interval each time.
+// Returns false when the VDP doesn't return within VDPREBOOT_TIMEOUT
+bool waitVDPreboot(SYSVAR *sysvars, uint32_t start, bool polled, uint32_t *ms) {
+	volatile SYSVAR *sv = (volatile SYSVAR *)sysvars;
+	uint32_t lastpoll, now;
+	uint32_t interval = VDPPOLL_FIRST * TIMER_TICKS_PER_MS;
+	uint8_t matched = 0;
+
+	lastpoll = timer_ticks();
+	echoVDP(VDPREBOOT_ECHO);
+	while(polled ? !vdpPollReplied(&matched) : (sv->scrHeight == 0)) {
+		tasks_run();
+		now = timer_ticks();
+		if((now - start) > ((uint32_t)VDPREBOOT_TIMEOUT * TIMER_TICKS_PER_MS)) {
+			*ms = (now - start) / TIMER_TICKS_PER_MS;
+			return false;
+		}
+		if((now - lastpoll) > interval) {
+			echoVDP(VDPREBOOT_ECHO);
+			lastpoll = now;
+			if(interval < (VDPPOLL_MAX * TIMER_TICKS_PER_MS)) interval *= 2;
+		}
+	}
+	*ms = (timer_ticks() - start) / TIMER_TICKS_PER_MS;
+	return true;
+}
+#endif
+
 int getCommand(const char *command) {
 	if(memcmp(command, "all\0", 4) == 0) return CMDALL;
 	if(memcmp(command, "mos\0", 4) == 0) return CMDMOS;
@@ -320,9 +988,40 @@ int getCommand(const char *command) {
 	if(memcmp(command, "-f\0", 3) == 0) return CMDFORCE;
 	if(memcmp(command, "force\0", 6) == 0) return CMDFORCE;
 	if(memcmp(command, "-force\0", 7) == 0) return CMDFORCE;
+	if(memcmp(command, "-d\0", 3) == 0) return CMDDIFF;
+	if(memcmp(command, "diff\0", 5) == 0) return CMDDIFF;
+#if FEATURE_BENCH
+	if(memcmp(command, "bench\0", 6) == 0) return CMDBENCH;
+#endif
+	if(memcmp(command, "-b\0", 3) == 0) return CMDBLOCK;
+	if(memcmp(command, "-n\0", 3) == 0) return CMDDRYRUN;
+	if(memcmp(command, "dryrun\0", 7) == 0) return CMDDRYRUN;
 	return CMDUNKNOWN;
 }
 
+// Selects the MOS firmware to flash, false when this build can't
+bool selectMOS(const char *filename) {
+#if FEATURE_MOS
+	mosfilename = filename;
+	flashmos = true;
+	return true;
+#else
+	(void)filename;
+	return false;
+#endif
+}
+
+bool selectVDP(const char *filename) {
+#if FEATURE_VDP
+	vdpfilename = filename;
+	flashvdp = true;
+	return true;
+#else
+	(void)filename;
+	return false;
+#endif
+}
+
 bool parseCommands(int argc, char *argv[]) {
 	int argcounter;
 	int command;
@@ -335,159 +1034,563 @@ bool parseCommands(int argc, char *argv[]) {
 				return false;
 				break;
 			case CMDALL:
+				// All that this build is able to update
 				if(flashmos || flashvdp) return false;
-				strcpy(mosfilename, DEFAULT_MOSFIRMWARE);
-				strcpy(vdpfilename, DEFAULT_VDPFIRMWARE);
-				flashmos = true;
-				flashvdp = true;
+				selectMOS(DEFAULT_MOSFIRMWARE);
+				selectVDP(DEFAULT_VDPFIRMWARE);
 				break;
 			case CMDMOS:
 				if(flashmos) return false;
 				if((argc > (argcounter+1)) && (getCommand(argv[argcounter + 1]) == CMDUNKNOWN)) {
-					strcpy(mosfilename, argv[argcounter + 1]);
+					if(!selectMOS(argv[argcounter + 1])) return false;
 					argcounter++;
 				}
 				else {
-					strcpy(mosfilename, DEFAULT_MOSFIRMWARE);
+					if(!selectMOS(DEFAULT_MOSFIRMWARE)) return false;
 				}
-				flashmos = true;
 				break;
 			case CMDVDP:
 				if(flashvdp) return false;
 				if((argc > (argcounter+1)) && (getCommand(argv[argcounter + 1]) == CMDUNKNOWN)) {
-					strcpy(vdpfilename, argv[argcounter + 1]);
+					if(!selectVDP(argv[argcounter + 1])) return false;
 					argcounter++;
 				}
 				else {
-					strcpy(vdpfilename, DEFAULT_VDPFIRMWARE);
+					if(!selectVDP(DEFAULT_VDPFIRMWARE)) return false;
 				}
-				flashvdp = true;
 				break;
 			case CMDBATCH:
 				if(optbatch) return false;
 				optbatch = true;
 				optforce = true;
-				strcpy(mosfilename, DEFAULT_MOSFIRMWARE);
-				strcpy(vdpfilename, DEFAULT_VDPFIRMWARE);
-				flashmos = true;
-				flashvdp = true;
 				break;
 			case CMDFORCE:
 				if(optforce && !optbatch) return false;
 				optforce = true;
 				break;
+			case CMDDIFF:
+				if(optdiff) return false;
+				optdiff = true;
+				break;
+#if FEATURE_BENCH
+			case CMDBENCH:
+				if(optbench) return false;
+				if((argc > (argcounter+1)) && (getCommand(argv[argcounter + 1]) == CMDUNKNOWN)) {
+					benchfilename = argv[argcounter + 1];
+					argcounter++;
+				}
+				optbench = true;
+				break;
+#endif
+			case CMDDRYRUN:
+				if(optdryrun) return false;
+				optdryrun = true;
+				flashtarget = DRYRUNTARGET;
+				break;
+			case CMDBLOCK:
+				// SD read block size in KB
+				if(argc <= (argcounter+1)) return false;
+				argcounter++;
+				sdread_blocksize = strtoul(argv[argcounter], NULL, 10);
+				if((sdread_blocksize == 0) || (sdread_blocksize > 64)) return false;
+				sdread_blocksize *= 1024;
+				break;
 		}
 		argcounter++;
 	}
+	if(optbench) return !(flashvdp || flashmos);
+	if(optbatch) {
+		// Batch flashes all firmware, using the defaults for files that weren't given
+		if(!flashmos) selectMOS(DEFAULT_MOSFIRMWARE);
+		if(!flashvdp) selectVDP(DEFAULT_VDPFIRMWARE);
+	}
 	return (flashvdp || flashmos);
 }
 
+// Reads the expected CRC32 and size of an image from the sidecar file "<filename>.crc",
+// containing "<crc32 in hex> <size in bytes>", as written by for example:
+// printf "%08X %d" $(crc32 MOS.bin) $(stat -c %s MOS.bin) > MOS.bin.crc
+bool readCRCfile(const char *filename, uint32_t *crc, uint24_t *size) {
+	uint8_t file;
+	char crcfilename[256+4];
+	char buffer[32];
+	char *ptr;
+	uint24_t length;
+
+	if(strlen(filename) > 255) return false;
+	strcpy(crcfilename, filename);
+	strcat(crcfilename, ".crc");
+	file = sdread_open(crcfilename);
+	if(!file) return false;
+	length = sdread(file, buffer, sizeof(buffer) - 1);
+	sdread_close(file);
+	buffer[length] = 0;
+
+	*crc = strtoul(buffer, &ptr, 16);
+	if(ptr == buffer) return false;
+	*size = strtoul(ptr, &ptr, 10);
+	if(*size == 0) return false;
+	return true;
+}
+
 bool openFiles(void) {
 	bool filesexist = true;
 
-    mosfilehandle = NULL;
-    vdpfilehandle = NULL;
+    mosfilehandle = 0;
+    vdpfilehandle = 0;
     
 	if(flashmos) {
-		mosfilehandle = fopen(mosfilename, "rb");
+		mosfilehandle = source_open(mosfilename);
 		if(!mosfilehandle) {
-			sprintf(message,"Error opening MOS firmware \"%s\"\n\r",mosfilename);
+			sformat(message,"Error opening MOS firmware \"%s\"\n\r",mosfilename);
             outstring(message);
 			filesexist = false;
 		}
 	}
 	if(flashvdp) {
-		vdpfilehandle = fopen(vdpfilename, "rb");
+		vdpfilehandle = source_open(vdpfilename);
 		if(!vdpfilehandle) {
-			sprintf(message,"Error opening VDP firmware \"%s\"\n\r",vdpfilename);
+			sformat(message,"Error opening VDP firmware \"%s\"\n\r",vdpfilename);
             outstring(message);
 			filesexist = false;
-            if(mosfilehandle) fclose(mosfilehandle);
+            if(mosfilehandle) source_close(mosfilehandle);
 		}
 	}
+	if(flashmos) mosknown = readCRCfile(mosfilename, &mosknowncrc, &mosknownsize);
+	if(flashvdp) vdpknown = readCRCfile(vdpfilename, &vdpknowncrc, &vdpknownsize);
 	return filesexist;
 }
 
+#if FEATURE_MOS
+bool validMOSImage(uint8_t *start, uint24_t size) {
+	bool valid = true;
+
+	if(!containsMosHeader(start)) {
+		sformat(message,"\"%s\" does not contain valid MOS ez80 startup code\r\n", mosfilename);
+		outstring(message);
+		valid = false;
+	}
+	if(size > FLASHSIZE) {
+		sformat(message,"\"%s\" too large for 128KB embedded flash\r\n", mosfilename);
+		outstring(message);
+		valid = false;
+	}
+	return valid;
+}
+#endif
+
 bool validFirmwareFiles(void) {
-	FILE* file;
-	uint24_t filesize;
-	uint8_t buffer[ESP32_MAGICLENGTH + ESP32_MAGICSTART];
+#if FEATURE_VDP
+	uint8_t buffer[ESP32_SHA256START + VDPIDENTITYLENGTH];
+#endif
 	bool validfirmware = true;
 
+#if FEATURE_MOS
 	if(flashmos) {
-        fseek(mosfilehandle, 0, SEEK_SET);
-		fread((char *)BUFFER1, 1, MOS_MAGICLENGTH, mosfilehandle);
-		if(!containsMosHeader((uint8_t *)BUFFER1)) {
-			sprintf(message,"\"%s\" does not contain valid MOS ez80 startup code\r\n", mosfilename);
-            outstring(message);
-			validfirmware = false;
+        source_rewind(mosfilehandle);
+		source_read(mosfilehandle, (char *)BUFFER1, MOS_MAGICLENGTH);
+		// A compressed image is checked once decompressed
+		moscompressed = lz4_isframe((uint8_t *)BUFFER1);
+		mossparse = isSparseImage((uint8_t *)BUFFER1);
+		if(!moscompressed && !mossparse) {
+			if(!validMOSImage((uint8_t *)BUFFER1, source_size(mosfilehandle))) validfirmware = false;
 		}
-		filesize = getFileSize(mosfilehandle->fhandle);
-		if(filesize > FLASHSIZE) {
-			sprintf(message,"\"%s\" too large for 128KB embedded flash\r\n", mosfilename);
-            outstring(message);
-			validfirmware = false;
-		}
-        fseek(mosfilehandle, 0, SEEK_SET);
+        source_rewind(mosfilehandle);
 	}
+#endif
+#if FEATURE_VDP
 	if(flashvdp) {
-        fseek(vdpfilehandle, 0, SEEK_SET);
-		fread((char *)buffer, 1, ESP32_MAGICLENGTH + ESP32_MAGICSTART, vdpfilehandle);
-		if(!containsESP32Header(buffer)) {
-			sprintf(message,"\"%s\" does not contain valid ESP32 code\r\n", vdpfilename);
+        source_rewind(vdpfilehandle);
+		source_read(vdpfilehandle, (char *)buffer, ESP32_SHA256START + VDPIDENTITYLENGTH);
+		// The ESP32 image inside a compressed file is checked by the VDP
+		vdpcompressed = lz4_isframe(buffer);
+		if(!vdpcompressed && !containsESP32Header(buffer)) {
+			sformat(message,"\"%s\" does not contain valid ESP32 code\r\n", vdpfilename);
             outstring(message);
 			validfirmware = false;
 		}
-        fseek(vdpfilehandle, 0, SEEK_SET);
+		if(!vdpcompressed) {
+			memcpy(vdpidentity, buffer + ESP32_SHA256START, VDPIDENTITYLENGTH);
+			vdpidentityknown = true;
+		}
+		if(vdpknown && (source_size(vdpfilehandle) != vdpknownsize)) {
+			sformat(message,"\"%s\" size doesn't match its .crc file\r\n", vdpfilename);
+			outstring(message);
+			validfirmware = false;
+		}
+        source_rewind(vdpfilehandle);
 	}
+#endif
 	return validfirmware;
 }
 
 void showCRC32(void) {
-	if(flashmos) {sprintf(message,"MOS CRC 0x%08lX\r\n", moscrc); outstring(message);}
-	if(flashvdp) {sprintf(message,"VDP CRC 0x%08lX\r\n", vdpcrc); outstring(message);}
+	if(flashmos) {
+		if(moscompressed) sformat(message,"MOS CRC 0x%08lX (decompressed, %u bytes)\r\n", moscrc, mossize);
+		else if(mossparse) sformat(message,"MOS CRC 0x%08lX (sparse, %u bytes)\r\n", moscrc, mossize);
+		else sformat(message,"MOS CRC 0x%08lX\r\n", moscrc);
+		outstring(message);
+	}
+	if(flashvdp) {
+		if(vdpknown) sformat(message,"VDP CRC 0x%08lX (from .crc file)\r\n", vdpcrc);
+		else sformat(message,"VDP CRC 0x%08lX\r\n", vdpcrc);
+		outstring(message);
+	}
+	outstring("\r\n");
+}
+
+#if FEATURE_MOS
+// Source for the LZ4 decompressor. Time spent here is accounted as SD read, not decompression
+uint24_t readMOSfile(void *buffer, uint24_t length) {
+	uint24_t bytesread;
+
+	phase_end(PHASE_DECOMPRESS, 0);
+	phase_begin(PHASE_SDREAD);
+	bytesread = source_read(mosfilehandle, (char *)buffer, length);
+	phase_end(PHASE_SDREAD, bytesread);
+	phase_begin(PHASE_DECOMPRESS);
+	putch('.');
+	if(userAborted()) return 0; // ends the decompression
+	return bytesread;
+}
+
+// Decompresses the MOS file to BUFFER1, checks and calculates the CRC32 of the decompressed image
+bool loadCompressedMOS(void) {
+	uint8_t status;
+
+	source_rewind(mosfilehandle);
+	phase_begin(PHASE_DECOMPRESS);
+	status = lz4_decompress(readMOSfile, (uint8_t *)BUFFER1, FLASHSIZE, (uint8_t *)BUFFER2, BUFFER2SIZE, &mossize);
+	phase_end(PHASE_DECOMPRESS, mossize);
+	source_rewind(mosfilehandle);
+	outstring("\r\n");
+	if(aborted) return false;
+
+	switch(status) {
+		case LZ4_OK:
+			break;
+		case LZ4_TOOLARGE:
+			return validMOSImage((uint8_t *)BUFFER1, FLASHSIZE + 1);
+		case LZ4_BLOCKSIZE:
+			sformat(message,"\"%s\" uses LZ4 blocks larger than 128KB\r\n", mosfilename);
+			outstring(message);
+			return false;
+		default:
+			sformat(message,"\"%s\" is not a valid LZ4 frame\r\n", mosfilename);
+			outstring(message);
+			return false;
+	}
+	if(!validMOSImage((uint8_t *)BUFFER1, mossize)) return false;
+
+	phase_begin(PHASE_CRC);
+	crc32_initialize();
+	crc32((char *)BUFFER1, mossize);
+	moscrc = crc32_finalize();
+	phase_end(PHASE_CRC, mossize);
+	return true;
+}
+
+static uint24_t get24(const uint8_t *data) {
+	return data[0] | (data[1] << 8) | ((uint24_t)data[2] << 16);
+}
+
+// Reads the ranges of a sparse MOS file to BUFFER1, filled with 0xFF first,
+// checks and calculates the CRC32 of the resulting image
+bool loadSparseMOS(void) {
+	uint8_t header[SPARSE_HEADER];
+	uint24_t offset, length, bytesread;
+	bool valid;
+
+	memset((void *)BUFFER1, 0xFF, FLASHSIZE);
+	source_rewind(mosfilehandle);
+	phase_begin(PHASE_SDREAD);
+	bytesread = source_read(mosfilehandle, header, SPARSE_HEADER);
+	valid = (bytesread == SPARSE_HEADER);
+	mossize = get24(header + SPARSE_MAGICLENGTH);
+	while(valid) {
+		length = source_read(mosfilehandle, header, SPARSE_RANGEHEADER);
+		bytesread += length;
+		if(length != SPARSE_RANGEHEADER) valid = false;
+		else {
+			offset = get24(header);
+			length = get24(header + 3);
+			if(length == 0) break;
+			// ranges stay inside the image and the flash
+			if((mossize > FLASHSIZE) || (offset > mossize) || (length > (mossize - offset))) valid = false;
+			else {
+				if(source_read(mosfilehandle, (char *)(BUFFER1 + offset), length) != length) valid = false;
+				bytesread += length;
+				putch('.');
+				if(userAborted()) valid = false;
+			}
+		}
+	}
+	phase_end(PHASE_SDREAD, bytesread);
+	source_rewind(mosfilehandle);
 	outstring("\r\n");
+	if(aborted) return false;
+	if(!valid) {
+		sformat(message,"\"%s\" is not a valid sparse MOS image\r\n", mosfilename);
+		outstring(message);
+		return false;
+	}
+	if(!validMOSImage((uint8_t *)BUFFER1, mossize)) return false;
+
+	phase_begin(PHASE_CRC);
+	crc32_initialize();
+	crc32((char *)BUFFER1, mossize);
+	moscrc = crc32_finalize();
+	phase_end(PHASE_CRC, mossize);
+	return true;
 }
+#endif
 
-void calculateCRC32(void) {
+bool calculateCRC32(void) {
 	uint24_t bytesread;
 	char* ptr;
 
 	moscrc = 0;
+	mossize = 0;
 	vdpcrc = 0;
 
 	outstring("Calculating CRC");
 
-	if(flashmos) {
-        fseek(mosfilehandle, 0, SEEK_SET);
+#if FEATURE_MOS
+	if(flashmos && moscompressed) {
+		if(!loadCompressedMOS()) return false;
+	}
+	else if(flashmos && mossparse) {
+		if(!loadSparseMOS()) return false;
+	}
+#endif
+	if(flashmos && !moscompressed && !mossparse) {
+        source_rewind(mosfilehandle);
 		ptr = (char*)BUFFER1;
 		crc32_initialize();
 		
 		// Read file to memory
-		while((bytesread = fread(ptr, 1, BLOCKSIZE, mosfilehandle)) > 0) {
+		while(true) {
+			phase_begin(PHASE_SDREAD);
+			bytesread = source_read(mosfilehandle, ptr, sdread_blocksize);
+			phase_end(PHASE_SDREAD, bytesread);
+			if(bytesread == 0) break;
+			phase_begin(PHASE_CRC);
 			crc32(ptr, bytesread);
+			phase_end(PHASE_CRC, bytesread);
 			ptr += bytesread;
 			putch('.');
+			if(userAborted()) return false;
 		}		
 		moscrc = crc32_finalize();
-        fseek(mosfilehandle, 0, SEEK_SET);
+		mossize = (uint24_t)ptr - BUFFER1;
+        source_rewind(mosfilehandle);
 	}
-	if(flashvdp) {
-        fseek(vdpfilehandle, 0, SEEK_SET);
+	if(flashmos && source_failed(mosfilehandle)) {
+		sformat(message,"\r\n\"%s\" stopped responding\r\n", mosfilename);
+		outstring(message);
+		return false;
+	}
+	if(flashmos && mosknown && ((moscrc != mosknowncrc) || (mossize != mosknownsize))) {
+		sformat(message,"\r\n\"%s\" doesn't match its .crc file\r\n", mosfilename);
+		outstring(message);
+		return false;
+	}
+	// The VDP CRC is only needed after the transfer without user verification,
+	// and checked against the .crc file when present
+	if(flashvdp && vdpknown) vdpcrc = vdpknowncrc;
+	else if(flashvdp && !optforce) {
+        source_rewind(vdpfilehandle);
 		crc32_initialize();
-        while((bytesread = fread((char *)BUFFER1, 1, BLOCKSIZE, vdpfilehandle)) > 0) {
-            crc32((char *)BUFFER1, bytesread);
-            putch('.');
-        }
+		// BUFFER1 holds the MOS image from here on
+		while(true) {
+			phase_begin(PHASE_SDREAD);
+			bytesread = source_read(vdpfilehandle, (char *)BUFFER2, sdread_blocksize);
+			phase_end(PHASE_SDREAD, bytesread);
+			if(bytesread == 0) break;
+			phase_begin(PHASE_CRC);
+			crc32((char *)BUFFER2, bytesread);
+			phase_end(PHASE_CRC, bytesread);
+			putch('.');
+			if(userAborted()) return false;
+		}
 		vdpcrc = crc32_finalize();
-        fseek(vdpfilehandle, 0, SEEK_SET);
+        source_rewind(vdpfilehandle);
+		if(source_failed(vdpfilehandle)) {
+			sformat(message,"\r\n\"%s\" stopped responding\r\n", vdpfilename);
+			outstring(message);
+			return false;
+		}
 	}
 	outstring("\r\n\r\n");
+	return true;
+}
+
+#if FEATURE_BENCH
+// Prints a single benchmark result line:
+// <test> <bytes> <microseconds> <bytes/s> <cycles/byte>
+void benchResult(const char *test, uint24_t bytes, uint32_t ticks) {
+	uint32_t cpb10;
+
+	if(ticks == 0) ticks = 1;
+	cpb10 = (ticks * 2560) / bytes; // 256 cycles per tick, in tenths
+	sformat(message,"%-12s %7u %8lu %8lu %4lu.%lu\r\n", test, bytes, (ticks * 125) / 9, (((uint32_t)bytes * 1125) / ticks) * 64, cpb10 / 10, cpb10 % 10);
+	outstring(message);
+}
+
+void benchCRC32(const char *test, uint24_t address, uint24_t bytes) {
+	uint32_t start;
+
+	start = timer_ticks();
+	crc32_initialize();
+	crc32((const char *)address, bytes);
+	crc32_finalize();
+	benchResult(test, bytes, timer_ticks() - start);
 }
 
-int main(int argc, char * argv[]) {	
+// Reads the start of the file to BUFFER1 at increasing SD read block sizes
+void benchSDread(const char *filename) {
+	char test[16];
+	uint24_t blocksize, bytes, savedblocksize, best = 0;
+	uint24_t offset, request;
+	uint32_t start, ticks, bestticks = 0;
+	uint8_t file;
+
+	file = sdread_open(filename);
+	if(!file) {
+		sformat(message,"Error opening \"%s\"\r\n", filename);
+		outstring(message);
+		return;
+	}
+	bytes = getFileSize(file);
+	if(bytes > FLASHSIZE) bytes = FLASHSIZE;
+	savedblocksize = sdread_blocksize;
+	for(blocksize = 512; blocksize <= 0x10000; blocksize *= 2) {
+		sdread_blocksize = blocksize;
+		sdread_rewind(file);
+		sformat(test, "sdread-%u", blocksize);
+		start = timer_ticks();
+		// Block by block, a single read could take longer than a TMR1 wrap
+		for(offset = 0; offset < bytes; offset += request) {
+			request = ((bytes - offset) > blocksize) ? blocksize : (bytes - offset);
+			sdread(file, (void *)(BUFFER1 + offset), request);
+			timer_ticks();
+		}
+		ticks = timer_ticks() - start;
+		benchResult(test, bytes, ticks);
+		// -b takes whole KBs
+		if((blocksize >= 1024) && ((best == 0) || (ticks < bestticks))) {
+			best = blocksize;
+			bestticks = ticks;
+		}
+	}
+	sformat(message,"Fastest SD read block size: -b %u (default %u)\r\n", best / 1024, SDREAD_BLOCKSIZE / 1024);
+	outstring(message);
+	sdread_blocksize = savedblocksize;
+	sdread_close(file);
+}
+
+void benchMemcpy(void) {
+	uint32_t start;
+
+	start = timer_ticks();
+	fastmemcpy(BUFFER2, BUFFER1, FLASHSIZE);
+	benchResult("fastmemcpy", FLASHSIZE, timer_ticks() - start);
+}
+
+// Flash against itself, so the compare always runs the full length
+void benchFlashcmp(void) {
+	uint32_t start;
+
+	start = timer_ticks();
+	flashcmp(FLASHSTART, FLASHSTART, FLASHSIZE);
+	benchResult("flashcmp", FLASHSIZE, timer_ticks() - start);
+}
+
+// Sends NUL bytes to the VDP in the background, up to the last byte handed to the UART
+void benchUART(void) {
+	uint32_t start;
+
+	memset((void *)BUFFER2, 0, BENCH_UARTBYTES);
+	uart0_flush();
+	start = timer_ticks();
+	uart0_txstart((void *)BUFFER2, BENCH_UARTBYTES);
+	while(uart0_txbusy());
+	benchResult("uart0-tx", BENCH_UARTBYTES, timer_ticks() - start);
+}
+
+// Round trips of a cursor position request; the bytes column counts the round trips
+void benchVDPpoll(void) {
+	uint32_t start;
+	uint8_t n, x, y;
+
+	uart0_flush();
+	start = timer_ticks();
+	for(n = 0; n < BENCH_VDPPOLLS; n++) {
+		if(!readCursor(&x, &y, VDPREPLY_TIMEOUT)) {
+			outstring("vdp-poll     no reply\r\n");
+			return;
+		}
+	}
+	benchResult("vdp-poll", BENCH_VDPPOLLS, timer_ticks() - start);
+}
+
+// One line per test: name, bytes, microseconds, bytes/s and cycles/byte
+void runBenchmarks(void) {
+	print_version();
+	outstring("test           bytes       us  bytes/s  cyc/B\r\n");
+	timer_start();
+	benchCRC32("crc32-ram", BUFFER1, FLASHSIZE);
+	benchCRC32("crc32-flash", FLASHSTART, FLASHSIZE);
+	benchMemcpy();
+	benchFlashcmp();
+	benchUART();
+	benchVDPpoll();
+	benchSDread(benchfilename);
+	outstring("\r\n");
+}
+#endif
+
+void showTimings(void) {
+	uint8_t phase;
+
+	outstring("Phase                ms    KB/s\r\n");
+	for(phase = 0; phase < PHASES; phase++) {
+		if(!phase_used(phase)) continue;
+		sformat(message,"%-14s %8lu %7lu\r\n", phase_name(phase), phase_ms(phase), phase_kbs(phase));
+		outstring(message);
+	}
+	outstring("\r\n");
+}
+
+// Final state on PortC, for a batch station
+void finalStatus(int result) {
+	if(result) status_set(STATUS_FAILED);
+	else status_set(vdplost ? STATUS_VDPLOST : STATUS_DONE);
+}
+
+// ESC was pressed before the point of no return, nothing has been updated.
+// Not a successful run, a batch station shows it as failed
+int abortRun(bool vdpopen) {
+	outstring("\r\nAborted\r\n");
+	if(vdpopen) source_close(vdpfilehandle);
+	if(flashmos) source_close(mosfilehandle);
+	return EXIT_FAILURE;
+}
+
+int flash(int argc, char * argv[]) {	
+#if FEATURE_VDP
     SYSVAR *sysvars = (SYSVAR *)mos_sysvars();
 	uint16_t tmp;
+	uint32_t rebootms;
+	bool vdpback, vdpsent;
+#endif
+#if FEATURE_MOS
+	bool mosflashed;
+#endif
+#if FEATURE_MOS && FEATURE_VDP
+	uint32_t rebootstart;
+	bool overlap = false; // MOS flashed during the VDP reboot
+#endif
 
     // DEBUG PortC pin option
     #if defined(DEBUG) && (DEBUG == 1) // Set all PortC pins to output && to 0
@@ -504,7 +1607,22 @@ int main(int argc, char * argv[]) {
 		usage();
 		return EXIT_INVALIDPARAMETER;
 	}
+#if FEATURE_BENCH
+	if(optbench) {
+		runBenchmarks();
+		return 0;
+	}
+#endif
 
+	// The timer runs from here on, tasks and timeouts count from its single start
+	phases_reset();
+	status_init(optbatch);
+	status_set(STATUS_PREPARE);
+	tasks_reset();
+	task_add(status_heartbeat, 0);
+	task_add(beepStep, 0);
+	task_add(escapeStep, ESCAPE_INTERVAL);
+	escapeReset();
 	if(!openFiles()) return EXIT_FILENOTFOUND;
 	if(!validFirmwareFiles()) {
 		return EXIT_INVALIDPARAMETER;
@@ -512,7 +1630,10 @@ int main(int argc, char * argv[]) {
 
 	putch(12);
 	print_version();
-	calculateCRC32();
+	if(!calculateCRC32()) {
+		if(aborted) return abortRun(flashvdp);
+		return EXIT_INVALIDPARAMETER;
+	}
 	// Skip showing CRC32 and user input when 'silent' is requested
 	if(!optforce) {
 		putch(12);
@@ -522,46 +1643,131 @@ int main(int argc, char * argv[]) {
 	}
 	if(optbatch) beep(1);
 
+#if FEATURE_VDP
 	if(flashvdp) {
-		while(sysvars->scrHeight == 0); // wait for 1st feedback from VDP
+		if(!optdryrun) { // wait for 1st feedback from VDP
+			while(sysvars->scrHeight == 0) if(userAborted()) return abortRun(true);
+		}
 		tmp = sysvars->scrHeight;
-		sysvars->scrHeight = 0;
+		if(!optdryrun) sysvars->scrHeight = 0;
         
         #if defined(DEBUG) && (DEBUG == 1) // Start update indicator, set PortC bit 0 to 1
             IO(PC_DR) = 1;
         #endif
 
-		if(update_vdp()) {
-			while(sysvars->scrHeight == 0) {
-                echoVDP(1);
-            };
+		status_set(STATUS_VDP);
+		vdpsent = update_vdp();
+		if(aborted) {
+			sysvars->scrHeight = tmp;
+			return abortRun(true);
+		}
+		if(vdpsent && optdryrun) {
+			if(!flashmos) {
+				showVDPresult();
+				showTimings();
+			}
+		}
+#if FEATURE_MOS
+		else if(vdpsent && flashmos) {
+			// The VDP takes a while to program its own flash and reboot, use that time to flash MOS.
+			// The reboot is confirmed afterwards
+			phase_begin(PHASE_VDPREBOOT);
+			rebootstart = timer_ticks();
+			overlap = true;
+		}
+#endif
+		else if(vdpsent) {
+			status_set(STATUS_VDPREBOOT);
+			phase_begin(PHASE_VDPREBOOT);
+			vdpback = waitVDPreboot(sysvars, timer_ticks(), false, &rebootms);
+			phase_end(PHASE_VDPREBOOT, 0);
+			if(vdpback) sformat(message,"VDP back after %lums\r\n", rebootms);
+			else {
+				sformat(message,"VDP didn't return within %lums\r\n", rebootms);
+				sysvars->scrHeight = tmp;
+				vdplost = true;
+			}
+			outstring(message);
+			if(!flashmos) {
+				showVDPresult();
+				showTimings();
+			}
+			if(optbatch && vdpback) beep(2);
+		}
+		else if(vdpunchanged) {
+			sysvars->scrHeight = tmp;
+			if(!flashmos) showVDPresult();
 			if(optbatch) beep(2);
 		}
+		else if(vdpupdated) {
+			// Firmware didn't match its expected CRC, or its transfer failed, and was rejected by the VDP.
+			// Don't flash anything else
+			sysvars->scrHeight = tmp;
+			showVDPresult();
+			source_close(vdpfilehandle);
+			if(flashmos) source_close(mosfilehandle);
+			return EXIT_INVALIDPARAMETER;
+		}
 		else {
 			if(!optforce && flashmos) {
 				askEscapeToContinue();
 				sysvars->scrHeight = tmp;
 			}
 		}
-	    fclose(vdpfilehandle);
+	    source_close(vdpfilehandle);
 
         #if defined(DEBUG) && (DEBUG == 1) // Stop update indicator (VDP is responsive), set PortC bit 0 to 0
             IO(PC_DR) = 0;
         #endif
 	}
+#endif
 
+#if FEATURE_MOS
 	if(flashmos) {
-		if(update_mos(mosfilename)) {
+		if(userAborted()) return abortRun(false);
+		status_set(STATUS_MOS);
+#if FEATURE_VDP
+		vdpoffline = overlap;
+#endif
+		mosflashed = update_mos();
+#if FEATURE_VDP
+		if(overlap) {
+			vdpoffline = false;
+			status_set(STATUS_VDPREBOOT);
+			// Interrupts stay disabled after programming MOS, the old MOS can't take the VDP reply anymore
+			vdpback = waitVDPreboot(sysvars, rebootstart, !mosunchanged, &rebootms);
+			phase_end(PHASE_VDPREBOOT, 0);
+			if(!vdpback) {
+				sysvars->scrHeight = tmp;
+				vdplost = true;
+			}
+			// Output during the reboot went nowhere, show what happened
+			putch(12);
+			print_version();
+			if(vdpback) sformat(message,"VDP back after %lums\r\n", rebootms);
+			else sformat(message,"VDP didn't return within %lums\r\n", rebootms);
+			outstring(message);
+			showVDPresult();
+			if(mosunchanged) outstring("MOS firmware unchanged\r\n");
+			if(optbatch && vdpback) beep(2);
+		}
+#endif
+		if(mosflashed) {
 			outstring("\r\nDone\r\n\r\n");
+			showTimings();
+			// Without a change to MOS or VDP, the running MOS can simply continue
+			if(optdryrun) return 0;
+			if(mosunchanged && !vdpupdated && !optbatch) return 0;
 			if(optbatch) {
 				outstring("Press reset button");
+				finalStatus(0);
 				beep(3);
-				while(1); // don't repeatedly run this command batched (autoexec.txt)
+				while(1) tasks_run(); // don't repeatedly run this command batched (autoexec.txt)
 			}
 			else {
 				outstring("System reset in ");
 				for(int n = 3; n > 0; n--) {
-					sprintf(message,"%d...", n);
+					sformat(message,"%d...", n);
                     outstring(message);
 					delayms(1000);
 				}
@@ -569,11 +1775,24 @@ int main(int argc, char * argv[]) {
 			}
 		}
 		else {
+			showTimings();
 			outstring("\r\nMultiple errors occured during flash write.\r\n");
 			outstring("Bare-metal recovery required.\r\n");
-			while(1); // No live MOS to return to
+			finalStatus(EXIT_FAILURE);
+			while(1) tasks_run(); // No live MOS to return to
 		}
 	}
+#endif
 	return 0;
 }
 
+int main(int argc, char * argv[]) {
+	int result;
+
+	uart0_txinstall();
+	result = flash(argc, argv);
+	finalStatus(result);
+	beepdrain();
+	uart0_txremove(); // sends any remaining output
+	return result;
+}
@@ -0,0 +1,75 @@
+/*
+ * Title:			Flash run phase timing
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ *                  Decompress phase
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "agontimer.h"
+#include "phases.h"
+
+// A phase can be entered multiple times, time and bytes accumulate
+typedef struct {
+	uint32_t start;
+	uint32_t ticks;
+	uint32_t bytes;
+	bool used;
+} PHASE;
+
+static PHASE phases[PHASES];
+
+static const char *phasenames[PHASES] = {
+	"SD read",
+	"CRC pre-pass",
+	"OTA unlock",
+	"VDP transfer",
+	"VDP reboot",
+	"Flash erase",
+	"Flash program",
+	"CRC verify",
+	"Decompress"
+};
+
+void phases_reset(void) {
+	uint8_t n;
+
+	for(n = 0; n < PHASES; n++) {
+		phases[n].ticks = 0;
+		phases[n].bytes = 0;
+		phases[n].used = false;
+	}
+	timer_start();
+}
+
+void phase_begin(uint8_t phase) {
+	phases[phase].start = timer_ticks();
+	phases[phase].used = true;
+}
+
+void phase_end(uint8_t phase, uint32_t bytes) {
+	phases[phase].ticks += timer_ticks() - phases[phase].start;
+	phases[phase].bytes += bytes;
+}
+
+const char *phase_name(uint8_t phase) {
+	return phasenames[phase];
+}
+
+uint32_t phase_ms(uint8_t phase) {
+	return phases[phase].ticks / TIMER_TICKS_PER_MS;
+}
+
+// KB/s = (bytes / 1024) / (ticks / 72000)
+uint32_t phase_kbs(uint8_t phase) {
+	if(phases[phase].ticks == 0) return 0;
+	return ((phases[phase].bytes / 16) * 1125) / phases[phase].ticks;
+}
+
+bool phase_used(uint8_t phase) {
+	return phases[phase].used;
+}
@@ -0,0 +1,35 @@
+/*
+ * Title:			Flash run phase timing
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ */
+
+#ifndef PHASES_H
+#define PHASES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PHASE_SDREAD		0
+#define PHASE_CRC			1
+#define PHASE_OTAUNLOCK		2
+#define PHASE_VDPTRANSFER	3
+#define PHASE_VDPREBOOT		4
+#define PHASE_ERASE			5
+#define PHASE_PROGRAM		6
+#define PHASE_VERIFY		7
+#define PHASE_DECOMPRESS	8
+#define PHASES				9
+
+void phases_reset(void);
+void phase_begin(uint8_t phase);
+void phase_end(uint8_t phase, uint32_t bytes);
+const char *phase_name(uint8_t phase);
+uint32_t phase_ms(uint8_t phase);
+uint32_t phase_kbs(uint8_t phase);
+bool phase_used(uint8_t phase);
+
+#endif //PHASES_H
@@ -0,0 +1,45 @@
+/*
+ * Title:			Direct SD card file reader
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ *
+ * Modinfo:
+ * 14/10/2026:		Initial version, MOS file API without stdio buffering
+ */
+
+#include <stdint.h>
+#include <mos_api.h>
+#include "sdread.h"
+
+uint24_t sdread_blocksize = SDREAD_BLOCKSIZE;
+
+// Returns the MOS filehandle, or 0 when the file can't be opened
+uint8_t sdread_open(const char *filename) {
+	return mos_fopen(filename, SDREAD_MODE);
+}
+
+void sdread_close(uint8_t filehandle) {
+	mos_fclose(filehandle);
+}
+
+void sdread_rewind(uint8_t filehandle) {
+	mos_flseek(filehandle, 0);
+}
+
+// Reads length bytes straight into buffer, in requests of sdread_blocksize.
+// Returns the number of bytes read, less than length only at the end of the file
+uint24_t sdread(uint8_t filehandle, void *buffer, uint24_t length) {
+	char *ptr = (char *)buffer;
+	uint24_t request, bytesread;
+	uint24_t total = 0;
+
+	while(length) {
+		request = (length > sdread_blocksize) ? sdread_blocksize : length;
+		bytesread = mos_fread(filehandle, ptr, request);
+		total += bytesread;
+		if(bytesread < request) break;
+		ptr += bytesread;
+		length -= bytesread;
+	}
+	return total;
+}
@@ -0,0 +1,25 @@
+/*
+ * Title:			Direct SD card file reader
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ *
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ */
+
+#ifndef SDREAD_H
+#define SDREAD_H
+
+#include <stdint.h>
+
+#define SDREAD_MODE			0x01	// FA_READ
+#define SDREAD_BLOCKSIZE	0x4000	// default size of a single MOS read request
+
+extern uint24_t sdread_blocksize;
+
+uint8_t sdread_open(const char *filename);
+void sdread_close(uint8_t filehandle);
+void sdread_rewind(uint8_t filehandle);
+uint24_t sdread(uint8_t filehandle, void *buffer, uint24_t length);
+
+#endif //SDREAD_H
@@ -0,0 +1,77 @@
+/*
+ * Title:			Firmware image sources
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version, SD card files and images streamed over UART1
+ *                  SD card files only, in builds without the UART1 source
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sdread.h"
+#include "filesize.h"
+#include "variant.h"
+#include "uart1src.h"
+#include "source.h"
+
+// Firmware images are read through a source handle: an SD card file handle from MOS, or
+// a UART1 image with SOURCE_UART1 set. Returns 0 when the image can't be opened
+uint8_t source_open(const char *name) {
+#if FEATURE_UART1
+	uint8_t image;
+	uint24_t prefix = strlen(SOURCE_UART1PREFIX);
+
+	if(strncmp(name, SOURCE_UART1PREFIX, prefix) == 0) {
+		image = uart1src_open(name + prefix);
+		if(image == UART1SRC_NOIMAGE) return 0;
+		return SOURCE_UART1 | image;
+	}
+#endif
+	return sdread_open(name);
+}
+
+void source_close(uint8_t handle) {
+#if FEATURE_UART1
+	if(handle & SOURCE_UART1) return; // nothing to release at the host
+#endif
+	sdread_close(handle);
+}
+
+void source_rewind(uint8_t handle) {
+#if FEATURE_UART1
+	if(handle & SOURCE_UART1) {
+		uart1src_rewind(handle & ~SOURCE_UART1);
+		return;
+	}
+#endif
+	sdread_rewind(handle);
+}
+
+uint24_t source_size(uint8_t handle) {
+#if FEATURE_UART1
+	if(handle & SOURCE_UART1) return uart1src_size(handle & ~SOURCE_UART1);
+#endif
+	return getFileSize(handle);
+}
+
+// Returns the number of bytes read, less than length only at the end of the image,
+// or when the source failed
+uint24_t source_read(uint8_t handle, void *buffer, uint24_t length) {
+#if FEATURE_UART1
+	if(handle & SOURCE_UART1) return uart1src_read(handle & ~SOURCE_UART1, buffer, length);
+#endif
+	return sdread(handle, buffer, length);
+}
+
+// A short read from UART1 can be a host that stopped responding, instead of the end of the image
+bool source_failed(uint8_t handle) {
+#if FEATURE_UART1
+	if(handle & SOURCE_UART1) return uart1src_failed();
+#else
+	(void)handle;
+#endif
+	return false;
+}
@@ -0,0 +1,26 @@
+/*
+ * Title:			Firmware image sources
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version, SD card files and images streamed over UART1
+ */
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SOURCE_UART1PREFIX	"uart1:"	// <prefix><name> is requested from the host on UART1
+#define SOURCE_UART1		0x80		// handle flag, SD card handles from MOS stay below
+
+uint8_t source_open(const char *name);
+void source_close(uint8_t handle);
+void source_rewind(uint8_t handle);
+uint24_t source_size(uint8_t handle);
+uint24_t source_read(uint8_t handle, void *buffer, uint24_t length);
+bool source_failed(uint8_t handle);
+
+#endif //SOURCE_H
@@ -0,0 +1,52 @@
+/*
+ * Title:			Headless status output on PortC
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ez80f92.h"
+#include "agontimer.h"
+#include "status.h"
+
+// A batch station watches PortC bits 4-7: the state of the run in bits 4-6, and a heartbeat in
+// bit 7 that toggles while work is in progress. A heartbeat that stops before a final state
+// (done, VDP lost, failed) is set means the run hung. Bits 0-3 are left alone
+
+static bool enabled = false;
+static bool beating = false;
+static uint32_t lastbeat;
+
+void status_init(bool enable) {
+	enabled = enable;
+	if(!enabled) return;
+	IO(PC_DR) = IO(PC_DR) & 0x0F;
+	IO(PC_ALT1) = IO(PC_ALT1) & 0x0F;
+	IO(PC_ALT2) = IO(PC_ALT2) & 0x0F;
+	IO(PC_DDR) = IO(PC_DDR) & 0x0F;	// bits 4-7 as outputs
+	lastbeat = timer_ticks();
+}
+
+void status_set(uint8_t state) {
+	if(!enabled) return;
+	IO(PC_DR) = (IO(PC_DR) & ~STATUS_MASK) | ((state << STATUS_SHIFT) & STATUS_MASK);
+	// the heartbeat stops, low, at a final state
+	beating = (state < STATUS_DONE);
+	if(!beating) IO(PC_DR) = IO(PC_DR) & ~STATUS_HEARTBEAT;
+}
+
+// Toggles the heartbeat at most every HEARTBEAT_INTERVAL. Only touches PortC, so it
+// is safe to call from anywhere, including the VDP transfer loops.
+// Keeps the free running timer going as well
+void status_heartbeat(void) {
+	uint32_t now = timer_ticks();
+
+	if(!beating) return;
+	if((now - lastbeat) < (HEARTBEAT_INTERVAL * TIMER_TICKS_PER_MS)) return;
+	IO(PC_DR) = IO(PC_DR) ^ STATUS_HEARTBEAT;
+	lastbeat = now;
+}
@@ -0,0 +1,35 @@
+/*
+ * Title:			Headless status output on PortC
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ */
+
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// State in PortC bits 4-6, heartbeat in bit 7
+#define STATUS_IDLE			0
+#define STATUS_PREPARE		1	// reading files, calculating CRCs
+#define STATUS_VDP			2	// VDP firmware transfer
+#define STATUS_VDPREBOOT	3	// waiting for the VDP to return
+#define STATUS_MOS			4	// MOS flash erase/program/verify
+#define STATUS_DONE			5
+#define STATUS_VDPLOST		6	// done, but the VDP didn't return
+#define STATUS_FAILED		7
+
+#define STATUS_SHIFT		4
+#define STATUS_MASK			0x70
+#define STATUS_HEARTBEAT	0x80
+#define HEARTBEAT_INTERVAL	250	// ms between heartbeat toggles
+
+void status_init(bool enable);
+void status_set(uint8_t state);
+void status_heartbeat(void);
+
+#endif //STATUS_H
@@ -0,0 +1,58 @@
+/*
+ * Title:			Cooperative background tasks
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "agontimer.h"
+#include "tasks.h"
+
+// The work loops of a flash run call tasks_run() whenever they can spare a moment, which
+// steps each task that is due, at most once per interval of the free running timer.
+// A step needs to return quickly, and shouldn't block on the VDP or the SD card
+
+typedef struct {
+	TASKSTEP step;
+	uint32_t interval;	// timer ticks
+	uint32_t last;
+} TASK;
+
+static TASK tasks[TASKS];
+static uint8_t taskcount = 0;
+static bool running = false;
+
+void tasks_reset(void) {
+	taskcount = 0;
+}
+
+// A task is stepped at its first tasks_run(), and every intervalms after that
+bool task_add(TASKSTEP step, uint16_t intervalms) {
+	TASK *task;
+
+	if(taskcount == TASKS) return false;
+	task = &tasks[taskcount++];
+	task->step = step;
+	task->interval = (uint32_t)intervalms * TIMER_TICKS_PER_MS;
+	task->last = timer_ticks() - task->interval;
+	return true;
+}
+
+void tasks_run(void) {
+	uint32_t now;
+	uint8_t n;
+
+	if(running) return; // a step that ends up in a work loop itself
+	running = true;
+	for(n = 0; n < taskcount; n++) {
+		now = timer_ticks();
+		if((now - tasks[n].last) < tasks[n].interval) continue;
+		tasks[n].last = now;
+		tasks[n].step();
+	}
+	running = false;
+}
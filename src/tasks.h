@@ -0,0 +1,24 @@
+/*
+ * Title:			Cooperative background tasks
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ */
+
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TASKS		4
+
+typedef void (*TASKSTEP)(void);
+
+void tasks_reset(void);
+bool task_add(TASKSTEP step, uint16_t intervalms);
+void tasks_run(void);
+
+#endif //TASKS_H
@@ -0,0 +1,573 @@
+;
+; Title:		UART0 interrupt driven transmit
+; Created:		14/10/2026
+; Last Updated:	14/10/2026
+;
+; Modinfo:
+;	14/10/2026: Initial version, background block transmit to the VDP
+;				Console output ring buffer, sent directly while interrupts are disabled
+;				Polled receive, for use with interrupts disabled
+;				Receive capture, taking VDP packets away from MOS during a chunked transfer
+;				Block bytes summed while filling the FIFO
+;				Console output no longer held back indefinitely by CTS
+;				CTS bypass for the VDP reboot polls
+;				Interrupt state save/restore around flag updates shared with MOS
+;
+; The handler is chained in front of the MOS UART0 handler. It only services
+; 'transmit holding register empty' interrupts; everything else (VDP packets
+; received by MOS) is passed on to the MOS handler untouched.
+; A block transmit has priority over the console ring. _uart0_txstart waits for
+; the ring to empty first, so console output can't end up inside a block to the
+; VDP, as long as nothing is printed while a block transmit is running.
+; With receive capture enabled, received bytes are kept in a ring for
+; _uart0_getch instead of being passed on to MOS.
+; CTS (PD3, active low) is checked before each burst, like MOS does before each
+; byte. When the VDP holds CTS, the transmit interrupt is switched off and
+; _uart0_txbusy switches it back on once CTS is asserted again.
+; Console output ignores a CTS that is held for longer than about 100ms, sending
+; regardless of it like the previous putch did, until the VDP asserts CTS again.
+; Without this, a VDP that is rebooting, or gone, would block putch forever.
+; Block transmits always wait for CTS.
+
+	.global _uart0_txinstall
+	.global _uart0_txremove
+	.global _uart0_txstart
+	.global _uart0_txbusy
+	.global _uart0_putch
+	.global _uart0_flush
+	.global _uart0_getch
+	.global _uart0_rxcapture
+	.global _uart0_txsum
+	.global _uart0_ctsbypass
+	.global _uart0_irqoff
+	.global _uart0_irqrestore
+
+    .assume adl = 1
+    .text
+
+UART0_THR	EQU $C0
+UART0_RBR	EQU $C0
+UART0_IER	EQU $C1
+UART0_IIR	EQU $C2
+UART0_LSR	EQU $C5
+PD_DR		EQU $A2
+UART0_IVECT	EQU $18
+IER_TIE		EQU $02		; transmit interrupt enable
+TXBURST		EQU 16		; UART0 transmit FIFO size
+CTSWAIT		EQU 131072	; CTS polls in txpolled before it's ignored, about 100ms at 18.432MHz
+RINGWAIT	EQU 32768	; ringwait calls before CTS is ignored, about 100ms as well
+
+; void uart0_txinstall(void)
+_uart0_txinstall:
+	PUSH    IX
+	PUSH    IY
+
+	LD      HL, 0
+	LD      (txcount), HL
+	XOR     A, A
+	LD      (rhead), A
+	LD      (rtail), A
+	LD      E, UART0_IVECT
+	LD      HL, uart0_handler
+	LD      A, $14 ; mos_setintvector
+	RST.LIL $08
+	LD      (oldhandler), HL	; MOS handler to chain to
+	LD      A, 1
+	LD      (txinstalled), A
+
+	POP     IY
+	POP     IX
+	RET
+
+; void uart0_txremove(void)
+; Sends any remaining console output before handing UART0 back to MOS
+_uart0_txremove:
+	PUSH    IX
+	PUSH    IY
+
+	LD      A, I				; P/V <- IFF2
+	PUSH    AF
+	DI
+	CALL    ringdrain
+	CALL    txdisable
+	XOR     A, A
+	LD      (txinstalled), A
+	LD      HL, 0
+	LD      (txcount), HL
+	LD      E, UART0_IVECT
+	LD      HL, (oldhandler)
+	LD      A, $14 ; mos_setintvector
+	RST.LIL $08
+	POP     AF
+	JP      PO, 1f
+	EI
+1:
+	POP     IY
+	POP     IX
+	RET
+
+; void uart0_rxcapture(bool enable)
+; Starts/stops keeping received bytes in the receive ring, away from MOS
+_uart0_rxcapture:
+	PUSH    IX
+	LD      IX, 0
+	ADD     IX, SP
+
+	XOR     A, A
+	LD      (rxhead), A
+	LD      (rxtail), A
+	LD      A, (IX+6)
+	LD      (rxcapture), A
+
+	LD      SP, IX
+	POP     IX
+	RET
+
+; int uart0_getch(void)
+; Returns the next received byte, or -1 when there is none. From the receive ring
+; while capturing, otherwise directly from the UART. The latter only with
+; interrupts disabled, when the MOS handler doesn't take the received bytes
+_uart0_getch:
+	LD      A, (rxcapture)
+	OR      A, A
+	JR      Z, 2f
+	LD      A, (rxhead)
+	LD      B, A
+	LD      HL, rxring
+	LD      A, (rxtail)
+	CP      A, B
+	JR      Z, 1f				; empty
+	LD      L, A
+	LD      A, (HL)
+	INC     L					; wraps in the aligned ring
+	LD      B, A
+	LD      A, L
+	LD      (rxtail), A
+	LD      HL, 0
+	LD      L, B
+	RET
+2:
+	IN0     A, (UART0_LSR)
+	BIT     0, A				; data ready
+	JR      Z, 1f
+	IN0     A, (UART0_RBR)
+	LD      HL, 0
+	LD      L, A
+	RET
+1:
+	LD      HL, -1
+	RET
+
+; void uart0_putch(uint8_t c)
+; Queues the character in the console ring, waiting for room when it is full.
+; Before installation, or with interrupts disabled, the ring is emptied and
+; the character sent directly
+_uart0_putch:
+	PUSH    IX
+	LD      IX, 0
+	ADD     IX, SP
+
+	LD      A, (txinstalled)
+	OR      A, A
+	JR      Z, 3f
+	LD      A, I				; P/V <- IFF2
+	JP      PO, 3f
+1:
+	LD      A, (rtail)
+	LD      B, A
+	LD      A, (rhead)
+	INC     A
+	CP      A, B				; full when head + 1 == tail
+	JR      NZ, 2f
+	CALL    ringwait
+	JR      1b
+2:
+	LD      HL, ring
+	LD      A, (rhead)
+	LD      L, A
+	LD      A, (IX+6)
+	LD      (HL), A
+	INC     L					; wraps in the aligned ring
+	LD      A, L
+	LD      (rhead), A			; publish after storing
+	CALL    txenable
+	JR      4f
+3:
+	CALL    ringdrain
+	LD      A, (IX+6)
+	CALL    txpolled
+4:
+	LD      SP, IX
+	POP     IX
+	RET
+
+; void uart0_txstart(const void *buffer, uint24_t length)
+; Starts transmitting the buffer in the background, the previous transmit needs to be completed
+_uart0_txstart:
+	PUSH    IX
+	LD      IX, 0
+	ADD     IX, SP
+
+	CALL    _uart0_flush		; console output goes out first
+	LD      HL, (IX+6)
+	LD      (txptr), HL
+	LD      HL, (IX+9)
+	LD      (txcount), HL
+	CALL    txenable			; an empty holding register raises the interrupt right away
+
+	LD      SP, IX
+	POP     IX
+	RET
+
+; uint8_t uart0_txsum(void)
+; Returns the 8bit sum of all block transmit bytes sent so far, wrapping around.
+; The sum over a transfer is the difference between the values before and after
+_uart0_txsum:
+	LD      A, (txsum)
+	RET
+
+; void uart0_ctsbypass(void)
+; Console output ignores CTS right away, until the VDP asserts it again
+_uart0_ctsbypass:
+	LD      A, 1
+	LD      (ctsbypass), A
+	RET
+
+; bool uart0_irqoff(void)
+; Disables interrupts, keeping MOS out of the UART0 interrupt and what it updates.
+; Returns true when interrupts were enabled, for uart0_irqrestore
+_uart0_irqoff:
+	LD      A, I				; P/V <- IFF2
+	DI
+	LD      A, 0
+	RET     PO
+	INC     A
+	RET
+
+; void uart0_irqrestore(bool enabled)
+; Re-enables interrupts, only when uart0_irqoff found them enabled
+_uart0_irqrestore:
+	PUSH    IX
+	LD      IX, 0
+	ADD     IX, SP
+
+	LD      A, (IX+6)
+	OR      A, A
+	JR      Z, 1f
+	EI
+1:
+	LD      SP, IX
+	POP     IX
+	RET
+
+; void uart0_flush(void)
+; Waits until the console ring has been handed to the UART
+_uart0_flush:
+	LD      A, (rtail)
+	LD      B, A
+	LD      A, (rhead)
+	CP      A, B
+	RET     Z
+	CALL    ringwait
+	JR      _uart0_flush
+
+; bool uart0_txbusy(void)
+; Returns true while bytes are still waiting to be handed to the UART
+_uart0_txbusy:
+	LD      HL, (txcount)
+	LD      DE, 0
+	OR      A, A
+	SBC     HL, DE
+	JR      NZ, 1f
+	XOR     A, A
+	RET
+1:
+	CALL    ctsresume
+	LD      A, 1
+	RET
+
+ctsresume:
+	IN0     A, (PD_DR)
+	BIT     3, A				; resume when the VDP asserts CTS again
+	RET     NZ
+	JR      txenable
+
+; Lets the interrupt send the console ring again once the VDP asserts CTS.
+; Called while waiting for the ring, CTS held for RINGWAIT calls is ignored
+ringwait:
+	IN0     A, (PD_DR)
+	BIT     3, A				; CTS, active low
+	JR      NZ, 1f
+	LD      HL, RINGWAIT
+	LD      (ctscount), HL
+	JR      txenable
+1:
+	LD      HL, (ctscount)
+	LD      DE, -1
+	ADD     HL, DE				; carry while the count was non-zero
+	LD      (ctscount), HL
+	RET     C
+	LD      HL, RINGWAIT
+	LD      (ctscount), HL
+	LD      A, 1
+	LD      (ctsbypass), A		; held too long
+	JR      txenable
+
+; Sends the console ring directly; interrupts need to be disabled
+ringdrain:
+	LD      HL, ring
+	LD      A, (rtail)
+	LD      L, A
+1:
+	LD      A, (rhead)
+	CP      A, L
+	JR      Z, 2f
+	LD      A, (HL)
+	CALL    txpolled
+	INC     L
+	JR      1b
+2:
+	LD      A, L
+	LD      (rtail), A
+	RET
+
+; Sends A directly, when the VDP asserts CTS and the transmitter is empty.
+; A CTS held for CTSWAIT polls is ignored from then on
+txpolled:
+	LD      C, A
+	LD      A, (ctsbypass)
+	OR      A, A
+	JR      NZ, 3f
+	PUSH    HL
+	PUSH    DE
+	LD      HL, CTSWAIT
+	LD      DE, -1
+1:
+	IN0     A, (PD_DR)
+	BIT     3, A				; CTS, active low
+	JR      Z, 4f
+	ADD     HL, DE				; carry while the count was non-zero
+	JR      C, 1b
+	LD      A, 1
+	LD      (ctsbypass), A		; held too long
+4:
+	POP     DE
+	POP     HL
+	JR      2f
+3:
+	IN0     A, (PD_DR)
+	BIT     3, A
+	JR      NZ, 2f
+	XOR     A, A
+	LD      (ctsbypass), A		; asserted again
+2:
+	IN0     A, (UART0_LSR)
+	AND     A, $40				; transmitter empty
+	JR      Z, 2b
+	OUT0    (UART0_THR), C
+	RET
+
+txenable:
+	LD      A, I				; P/V <- IFF2
+	PUSH    AF
+	DI
+	IN0     A, (UART0_IER)
+	OR      A, IER_TIE
+	OUT0    (UART0_IER), A
+	POP     AF
+	RET     PO
+	EI
+	RET
+
+txdisable:
+	LD      A, I				; P/V <- IFF2
+	PUSH    AF
+	DI
+	IN0     A, (UART0_IER)
+	RES     1, A				; IER_TIE
+	OUT0    (UART0_IER), A
+	POP     AF
+	RET     PO
+	EI
+	RET
+
+uart0_handler:
+	PUSH    AF
+	PUSH    BC
+	PUSH    DE
+	PUSH    HL
+
+	IN0     A, (UART0_IIR)		; clears a pending transmit interrupt
+	LD      D, A
+	AND     A, $0F
+	CP      A, $02				; pending 'transmit holding register empty'?
+	JR      NZ, rxserve
+
+	LD      HL, (txcount)
+	LD      BC, 0
+	OR      A, A
+	SBC     HL, BC
+	JR      Z, ringserve		; no block, console output
+
+	IN0     A, (PD_DR)
+	BIT     3, A				; CTS, active low
+	JR      NZ, 2f				; hold, _uart0_txbusy resumes
+
+	LD      C, 1				; single holding register
+	LD      A, D
+	AND     A, $C0				; FIFO enabled?
+	JR      Z, 1f
+	LD      C, TXBURST
+1:
+	OR      A, A
+	SBC     HL, BC				; count - burst
+	JR      NC, 3f
+	ADD     HL, BC				; less than a full burst left
+	PUSH    HL
+	POP     BC
+	LD      HL, 0
+3:
+	LD      (txcount), HL
+	LD      HL, (txptr)
+	LD      B, C				; 1 - TXBURST bytes
+	LD      A, (txsum)
+	LD      E, A
+5:
+	LD      A, (HL)
+	OUT0    (UART0_THR), A
+	ADD     A, E				; summed on the way out, instead of by the caller
+	LD      E, A
+	INC     HL
+	DJNZ    5b
+	LD      A, E
+	LD      (txsum), A
+	LD      (txptr), HL
+	JR      4f
+
+ringserve:
+	LD      A, (rtail)
+	LD      E, A
+	LD      A, (rhead)
+	SUB     A, E				; bytes queued
+	JR      Z, 2f				; all done
+	LD      C, A
+
+	IN0     A, (PD_DR)
+	BIT     3, A				; CTS, active low
+	JR      Z, 8f
+	LD      A, (ctsbypass)
+	OR      A, A
+	JR      Z, 2f				; hold, resumed from the foreground
+	JR      9f
+8:
+	XOR     A, A
+	LD      (ctsbypass), A		; asserted again
+	LD      HL, RINGWAIT
+	LD      (ctscount), HL
+9:
+
+	LD      B, 1				; single holding register
+	LD      A, D
+	AND     A, $C0				; FIFO enabled?
+	JR      Z, 5f
+	LD      B, TXBURST
+5:
+	LD      A, C
+	CP      A, B
+	JR      NC, 6f				; at least a full burst queued
+	LD      B, A
+6:
+	LD      HL, ring
+	LD      L, E				; HL -> ring[tail]
+7:
+	LD      A, (HL)
+	OUT0    (UART0_THR), A
+	INC     L
+	DJNZ    7b
+	LD      A, L
+	LD      (rtail), A
+	JR      4f
+2:
+	IN0     A, (UART0_IER)
+	RES     1, A				; IER_TIE
+	OUT0    (UART0_IER), A
+4:
+	POP     HL
+	POP     DE
+	POP     BC
+	POP     AF
+	EI
+	RETI.L
+
+rxserve:
+	LD      E, A
+	LD      A, (rxcapture)
+	OR      A, A
+	JR      Z, chain
+	LD      A, E
+	CP      A, $04				; receive data ready
+	JR      Z, 1f
+	CP      A, $0C				; character timeout
+	JR      NZ, chain
+1:
+	LD      HL, rxring
+	LD      A, (rxhead)
+	LD      L, A
+2:
+	IN0     A, (UART0_LSR)
+	BIT     0, A				; data ready
+	JR      Z, 3f
+	IN0     A, (UART0_RBR)
+	LD      (HL), A
+	INC     L					; wraps in the aligned ring
+	LD      A, (rxtail)
+	CP      A, L
+	JR      NZ, 2b
+	DEC     L					; ring full, the byte is dropped
+	JR      2b
+3:
+	LD      A, L
+	LD      (rxhead), A
+	JR      4b
+
+chain:
+	POP     HL
+	POP     DE
+	POP     BC
+	POP     AF
+	PUSH    HL
+	LD      HL, (oldhandler)
+	EX      (SP), HL			; restores HL, leaves the MOS handler address on the stack
+	RET
+
+    .data
+	.ALIGN 8
+ring:							; console output, wraps on the low address byte
+	.space 256
+rxring:							; captured received bytes, aligned by following ring
+	.space 256
+rxhead:
+	.db 0
+rxtail:
+	.db 0
+rxcapture:
+	.db 0
+rhead:
+	.db 0
+rtail:
+	.db 0
+txinstalled:
+	.db 0
+oldhandler:
+	.d24 0
+txptr:
+	.d24 0
+txcount:
+	.d24 0
+txsum:
+	.db 0
+ctsbypass:
+	.db 0						; CTS held too long, console output ignores it
+ctscount:
+	.d24 RINGWAIT
+end
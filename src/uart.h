@@ -0,0 +1,20 @@
+#ifndef UART_H
+#define UART_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+extern void uart0_txinstall(void);
+extern void uart0_txremove(void);
+extern void uart0_txstart(const void *buffer, uint24_t length);
+extern bool uart0_txbusy(void);
+extern uint8_t uart0_txsum(void);
+extern void uart0_putch(uint8_t c);
+extern void uart0_flush(void);
+extern void uart0_ctsbypass(void);
+extern bool uart0_irqoff(void);
+extern void uart0_irqrestore(bool enabled);
+extern int uart0_getch(void);
+extern void uart0_rxcapture(bool enable);
+
+#endif //UART_H
@@ -0,0 +1,199 @@
+/*
+ * Title:			Firmware image source over UART1
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ *                  Left out of builds without the UART1 source
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "ez80f92.h"
+#include "agontimer.h"
+#include "crc32.h"
+#include "status.h"
+#include "variant.h"
+#include "uart1src.h"
+
+#if FEATURE_UART1
+
+// A host (fixture PC) on UART1 serves the firmware images. The host only sends in reply to a
+// request, one frame at a time, so the images are pulled in at the pace of the reader and
+// nothing needs to be held in RAM. Every reply is checked with its CRC32; a reply that
+// doesn't arrive in time or doesn't check out is requested again
+
+typedef struct {
+	uint24_t size;
+	uint24_t offset;
+} UART1IMAGE;
+
+static UART1IMAGE images[UART1SRC_IMAGES];
+static bool initialized = false;
+static bool failed = false;
+
+static uint24_t get24(const uint8_t *data) {
+	return data[0] | (data[1] << 8) | ((uint24_t)data[2] << 16);
+}
+
+static void put24(uint8_t *data, uint24_t value) {
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+	data[2] = (value >> 16) & 0xFF;
+}
+
+static void uart1_init(void) {
+	uint16_t brg = (SYSCLK_NOMINAL + (8UL * UART1SRC_BAUD)) / (16UL * UART1SRC_BAUD);
+
+	// TXD1/RXD1 on PC0/PC1, as alternate function
+	IO(PC_DDR) = IO(PC_DDR) | 0x03;
+	IO(PC_ALT1) = IO(PC_ALT1) & ~0x03;
+	IO(PC_ALT2) = IO(PC_ALT2) | 0x03;
+
+	IO(UART1_LCTL) = 0x80;			// baudrate generator access
+	IO(UART1_BRG_L) = brg & 0xFF;
+	IO(UART1_BRG_H) = (brg >> 8) & 0xFF;
+	IO(UART1_LCTL) = 0x03;			// 8N1
+	IO(UART1_FCTL) = 0x07;			// FIFOs enabled and cleared
+	IO(UART1_IER) = 0;				// polled
+	initialized = true;			// timeouts use the run timer, started by flash()
+}
+
+static void uart1_send(const uint8_t *data, uint24_t length) {
+	while(length--) {
+		while(!(IO(UART1_LSR) & 0x20));	// transmit holding register empty
+		IO(UART1_THR) = *data++;
+	}
+}
+
+// Drops anything left over from an earlier reply
+static void uart1_flushrx(void) {
+	uint8_t c;
+
+	while(IO(UART1_LSR) & 0x01) c = IO(UART1_RBR);
+	(void)c;
+}
+
+// Receives length bytes, until UART1SRC_TIMEOUT after start
+static bool uart1_receive(uint8_t *data, uint24_t length, uint32_t start) {
+	while(length) {
+		if(IO(UART1_LSR) & 0x01) {
+			*data++ = IO(UART1_RBR);
+			length--;
+		}
+		else if((timer_ticks() - start) > ((uint32_t)UART1SRC_TIMEOUT * TIMER_TICKS_PER_MS)) return false;
+	}
+	return true;
+}
+
+// Receives a reply of the given type, with a fixed size head, followed by up to maxdata bytes.
+// Returns the number of data bytes, or -1 on a timeout, a CRC32 error or an unexpected reply
+static int uart1_reply(uint8_t type, uint8_t *head, uint24_t headlength, uint8_t *data, uint24_t maxdata) {
+	uint8_t header[3];
+	uint8_t trailer[4];
+	uint8_t sync = 0;
+	uint24_t length;
+	uint32_t start = timer_ticks();
+	uint32_t state, crc;
+
+	while(sync != UART1SRC_SYNC) {
+		if(!uart1_receive(&sync, 1, start)) return -1;
+	}
+	if(!uart1_receive(header, sizeof(header), start)) return -1;
+	length = header[1] | (header[2] << 8);
+	if((header[0] != type) || (length < headlength) || ((length - headlength) > maxdata)) return -1;
+	if(!uart1_receive(head, headlength, start)) return -1;
+	if(!uart1_receive(data, length - headlength, start)) return -1;
+	if(!uart1_receive(trailer, sizeof(trailer), start)) return -1;
+
+	// the file CRC32 might be running, around this one
+	crc32_suspend(&state);
+	crc32_initialize();
+	crc32((char *)header, sizeof(header));
+	crc32((char *)head, headlength);
+	crc32((char *)data, length - headlength);
+	crc = crc32_finalize();
+	crc32_resume(&state);
+	if(crc != (get24(trailer) | ((uint32_t)trailer[3] << 24))) return -1;
+	return length - headlength;
+}
+
+// Returns the image number the host serves the named image as, or UART1SRC_NOIMAGE
+uint8_t uart1src_open(const char *name) {
+	uint8_t head[4];
+	uint8_t request = UART1SRC_OPEN;
+	uint8_t retry;
+
+	if(!initialized) uart1_init();
+	for(retry = 0; retry <= UART1SRC_RETRIES; retry++) {
+		uart1_flushrx();
+		uart1_send(&request, 1);
+		uart1_send((const uint8_t *)name, strlen(name) + 1);
+		if(uart1_reply(UART1SRC_IMAGE, head, sizeof(head), NULL, 0) != 0) continue;
+		if(head[0] >= UART1SRC_IMAGES) return UART1SRC_NOIMAGE;
+		images[head[0]].size = get24(head + 1);
+		images[head[0]].offset = 0;
+		return head[0];
+	}
+	return UART1SRC_NOIMAGE;
+}
+
+uint24_t uart1src_size(uint8_t image) {
+	return images[image].size;
+}
+
+void uart1src_rewind(uint8_t image) {
+	images[image].offset = 0;
+}
+
+bool uart1src_failed(void) {
+	return failed;
+}
+
+static bool uart1_readframe(uint8_t image, uint24_t offset, uint8_t *data, uint24_t length) {
+	uint8_t request[7];
+	uint8_t head[4];
+	uint8_t retry;
+
+	request[0] = UART1SRC_READ;
+	request[1] = image;
+	put24(request + 2, offset);
+	request[5] = length & 0xFF;
+	request[6] = (length >> 8) & 0xFF;
+	for(retry = 0; retry <= UART1SRC_RETRIES; retry++) {
+		uart1_flushrx();
+		uart1_send(request, sizeof(request));
+		if(uart1_reply(UART1SRC_DATA, head, sizeof(head), data, length) != (int)length) continue;
+		if((head[0] == image) && (get24(head + 1) == offset)) return true;
+	}
+	return false;
+}
+
+// Reads from the current offset in the image, a frame of at most UART1SRC_FRAMESIZE bytes at a time.
+// Returns the number of bytes read, less than length at the end of the image, or when
+// the host stopped responding
+uint24_t uart1src_read(uint8_t image, void *buffer, uint24_t length) {
+	UART1IMAGE *source = &images[image];
+	uint8_t *ptr = (uint8_t *)buffer;
+	uint24_t request, total = 0;
+
+	while(length && (source->offset < source->size)) {
+		request = length;
+		if(request > UART1SRC_FRAMESIZE) request = UART1SRC_FRAMESIZE;
+		if(request > (source->size - source->offset)) request = source->size - source->offset;
+		if(!uart1_readframe(image, source->offset, ptr, request)) {
+			failed = true;
+			break;
+		}
+		source->offset += request;
+		ptr += request;
+		total += request;
+		length -= request;
+		status_heartbeat();
+	}
+	return total;
+}
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * Title:			Firmware image source over UART1
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ */
+
+#ifndef UART1SRC_H
+#define UART1SRC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UART1SRC_BAUD		1152000
+#define UART1SRC_IMAGES		2		// MOS and VDP firmware
+#define UART1SRC_FRAMESIZE	4096	// data bytes per read request
+#define UART1SRC_TIMEOUT	500		// ms before a request is repeated
+#define UART1SRC_RETRIES	5
+
+// Requests to the host
+#define UART1SRC_OPEN		'O'		// 'O',<name>,0
+#define UART1SRC_READ		'R'		// 'R',<image>,<24bit offset>,<16bit length>
+// Replies from the host: UART1SRC_SYNC,<type>,<16bit payload length>,<payload>,<CRC32 of type, length and payload>
+#define UART1SRC_SYNC		0xA5
+#define UART1SRC_IMAGE		'O'		// <image>,<24bit size>, image 0xFF when not available
+#define UART1SRC_DATA		'D'		// <image>,<24bit offset>,<data>
+#define UART1SRC_NOIMAGE	0xFF
+
+uint8_t uart1src_open(const char *name);
+uint24_t uart1src_size(uint8_t image);
+uint24_t uart1src_read(uint8_t image, void *buffer, uint24_t length);
+void uart1src_rewind(uint8_t image);
+bool uart1src_failed(void);
+
+#endif //UART1SRC_H
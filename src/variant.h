@@ -0,0 +1,35 @@
+/*
+ * Title:			Build variants
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ * 
+ * Modinfo:
+ * 14/10/2026:		Initial version
+ */
+
+#ifndef VARIANT_H
+#define VARIANT_H
+
+// Set by the Makefile, 'make SLIM=1 FEATURES=MOS|VDP'.
+// Code behind a disabled feature is left out by the compiler
+#ifndef SLIM
+#define SLIM			0	// small formatter instead of the stdio printf family
+#endif
+#ifndef FEATURE_MOS
+#define FEATURE_MOS		1	// MOS firmware updates
+#endif
+#ifndef FEATURE_VDP
+#define FEATURE_VDP		1	// VDP firmware updates
+#endif
+#ifndef FEATURE_BENCH
+#define FEATURE_BENCH	(!SLIM)
+#endif
+#ifndef FEATURE_UART1
+#define FEATURE_UART1	(!SLIM)	// firmware images from a host on UART1
+#endif
+
+#if !FEATURE_MOS && !FEATURE_VDP
+#error "Nothing left to update, enable FEATURE_MOS and/or FEATURE_VDP"
+#endif
+
+#endif //VARIANT_H
@@ -0,0 +1,424 @@
+/*
+ * Title:			VDP firmware streaming
+ * Created:			14/10/2026
+ * Last Updated:	14/10/2026
+ *
+ * Modinfo:
+ * 14/10/2026:		Moved from flash.asm, double-buffered streaming
+ *                  SD reads overlap with the background UART0 transmit
+ *                  CRC32 of the file is calculated during the transfer
+ *                  Compressed LZ4 frame protocol, from a compressed file or compressed while sending
+ *                  Checksum is corrupted when the file doesn't match its expected CRC32
+ *                  Reads through the shared SD reader
+ *                  UART0 transmit handler installed for the whole run, by main
+ *                  Byte counting sink instead of the VDP, for dry runs
+ *                  Chunked transfers, each chunk acknowledged by the VDP and resent on its own
+ *                  Checksum summed by the UART0 transmit handler, while filling the FIFO
+ *                  Left out of builds without VDP updates
+ *                  Status packet from the VDP after unlocking, with its capabilities
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "flash.h"
+#include "uart.h"
+#include "status.h"
+#include "crc32.h"
+#include "lz4.h"
+#include "source.h"
+#include "agontimer.h"
+#include "variant.h"
+#include "vdpupdate.h"
+
+#if FEATURE_VDP
+
+#define LZ4_BLOCKHEADER	4
+
+// LZ4 frame header: version 01, independent blocks, 64KB maximum block size, header checksum
+static const uint8_t lz4_frameheader[] = {0x04, 0x22, 0x4D, 0x18, 0x60, 0x40, 0x82};
+static const uint8_t lz4_endmark[LZ4_BLOCKHEADER] = {0, 0, 0, 0};
+
+static bool sink = false;
+static uint32_t sinkbytes;
+static uint8_t sinksum;
+
+// Chunks in flight, kept until acknowledged
+typedef struct {
+	uint8_t *frame;
+	uint24_t length;		// frame bytes
+	bool acked;
+} VDPCHUNK;
+
+static VDPCHUNK chunks[VDPCHUNK_WINDOW];
+static uint8_t txslot;			// chunk slot handed to the UART last
+static bool chunkfailed = false;
+static uint16_t chunksresent;
+
+// VDP packet receive state
+static uint8_t rxstate = 0;
+static uint8_t rxcode, rxlength, rxcount;
+static uint8_t rxdata[VDPSTATUS_LENGTH];
+
+static uint8_t vdp_sum(const uint8_t *data, uint24_t length) {
+	uint8_t sum = 0;
+
+	while(length--) sum += *data++;
+	return sum;
+}
+
+static void vdp_txstart(const void *data, uint24_t length) {
+	if(sink) {
+		sinkbytes += length;
+		sinksum += vdp_sum(data, length);
+		return;
+	}
+	uart0_txstart(data, length);
+}
+
+// Running 8bit sum of all bytes sent
+static uint8_t vdp_txsum(void) {
+	if(sink) return sinksum;
+	return uart0_txsum();
+}
+
+static bool vdp_txbusy(void) {
+	if(sink) return false;
+	return uart0_txbusy();
+}
+
+static void vdp_send(const void *data, uint24_t length) {
+	vdp_txstart(data, length);
+	while(vdp_txbusy());
+}
+
+// With the sink enabled, nothing is sent to the VDP; the bytes are only counted and summed
+void vdpupdate_sink(bool enable) {
+	sink = enable;
+	sinkbytes = 0;
+	sinksum = 0;
+}
+
+uint32_t vdpupdate_sinkbytes(void) {
+	return sinkbytes;
+}
+
+uint8_t vdpupdate_sinksum(void) {
+	return sinksum;
+}
+
+static void vdp_start(uint8_t command, uint24_t size) {
+	uint8_t header[7];
+
+	header[0] = 23;
+	header[1] = 0;
+	header[2] = 0xA1;
+	header[3] = command;
+	header[4] = size & 0xFF;
+	header[5] = (size >> 8) & 0xFF;
+	header[6] = (size >> 16) & 0xFF;
+	vdp_send(header, sizeof(header));
+}
+
+// Sends the file as-is, double-buffered
+static uint8_t vdp_sendfile(uint8_t filehandle) {
+	uint8_t *buffer[2] = {(uint8_t *)VDPBUFFER_A, (uint8_t *)VDPBUFFER_B};
+	uint8_t start = vdp_txsum();
+	uint24_t bytesread, nextread;
+	uint8_t current = 0;
+
+	bytesread = source_read(filehandle, buffer[current], VDPCHUNKSIZE);
+	while(bytesread) {
+		// transmit the current buffer in the background, while reading the next chunk in the other
+		vdp_txstart(buffer[current], bytesread);
+		crc32((char *)buffer[current], bytesread);
+		nextread = source_read(filehandle, buffer[current ^ 1], VDPCHUNKSIZE);
+		while(vdp_txbusy());
+		status_heartbeat(); // keeps the run timer going as well
+		current ^= 1;
+		bytesread = nextread;
+	}
+	return vdp_txsum() - start;
+}
+
+// Sends the file as an LZ4 frame, one independent block per chunk.
+// Each chunk is compressed into the output buffer that isn't being transmitted;
+// chunks that don't get smaller are sent as a raw block
+static uint8_t vdp_sendcompressed(uint8_t filehandle) {
+	uint8_t *output[2] = {(uint8_t *)VDPLZ4_OUT_A, (uint8_t *)VDPLZ4_OUT_B};
+	uint8_t *input = (uint8_t *)VDPLZ4_IN;
+	uint8_t *block;
+	uint8_t start = vdp_txsum();
+	uint24_t bytesread, size;
+	uint8_t current = 0;
+
+	vdp_send(lz4_frameheader, sizeof(lz4_frameheader));
+
+	while((bytesread = source_read(filehandle, input, VDPCHUNKSIZE))) {
+		crc32((char *)input, bytesread);
+		block = output[current];
+		size = lz4_compressblock(input, bytesread, block + LZ4_BLOCKHEADER, (uint16_t *)VDPLZ4_HASHTABLE);
+		if(size) block[3] = 0;
+		else {
+			size = bytesread;
+			memcpy(block + LZ4_BLOCKHEADER, input, size);
+			block[3] = 0x80;
+		}
+		block[0] = size & 0xFF;
+		block[1] = (size >> 8) & 0xFF;
+		block[2] = (size >> 16) & 0xFF;
+		size += LZ4_BLOCKHEADER;
+
+		while(vdp_txbusy());
+		status_heartbeat(); // keeps the run timer going as well
+		vdp_txstart(block, size);
+		current ^= 1;
+	}
+	while(vdp_txbusy());
+	vdp_send(lz4_endmark, LZ4_BLOCKHEADER);
+	return vdp_txsum() - start;
+}
+
+static void vdp_put32(uint8_t *data, uint32_t value) {
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+	data[2] = (value >> 16) & 0xFF;
+	data[3] = (value >> 24) & 0xFF;
+}
+
+bool vdpupdate_failed(void) {
+	return chunkfailed;
+}
+
+uint16_t vdpupdate_resent(void) {
+	return chunksresent;
+}
+
+// Reads VDP packets from the receive capture. Returns true when a packet with this code and length
+// came in, its data in rxdata; other packets are dropped
+static bool vdp_packet(uint8_t code, uint8_t length) {
+	int c;
+
+	while((c = uart0_getch()) >= 0) {
+		switch(rxstate) {
+			case 0: // packet code
+				if(c & 0x80) {
+					rxcode = c & 0x7F;
+					rxstate = 1;
+				}
+				break;
+			case 1: // length
+				rxlength = c;
+				rxcount = 0;
+				rxstate = rxlength ? 2 : 0;
+				break;
+			default:
+				if(rxcount < sizeof(rxdata)) rxdata[rxcount] = c;
+				if(++rxcount < rxlength) break;
+				rxstate = 0;
+				if((rxcode == code) && (rxlength == length)) return true;
+				break;
+		}
+	}
+	return false;
+}
+
+static bool vdp_ackpacket(uint8_t *status, uint16_t *seq) {
+	if(!vdp_packet(VDPOTA_ACKPACKET, VDPACK_LENGTH)) return false;
+	*status = rxdata[0];
+	*seq = rxdata[1] | (rxdata[2] << 8);
+	return true;
+}
+
+// Waits for the status packet the VDP sends after VDPOTA_UNLOCK, with the receive capture
+// enabled by the caller. Returns false when none came in within timeoutms
+bool vdpupdate_status(uint8_t *status, uint24_t timeoutms) {
+	uint32_t start = timer_ticks();
+
+	rxstate = 0;
+	while(!vdp_packet(VDPOTA_STATUSPACKET, VDPSTATUS_LENGTH)) {
+		if((timer_ticks() - start) > ((uint32_t)timeoutms * TIMER_TICKS_PER_MS)) return false;
+	}
+	memcpy(status, rxdata, VDPSTATUS_LENGTH);
+	return true;
+}
+
+// Reads the next chunk of the file into the frame of its slot:
+// <16bit sequence>,<flags>,<16bit payload length>,<payload>,<CRC32 of the chunk file bytes>
+// The CRC32 of the whole file continues over the chunk as well
+static void vdp_chunkread(uint8_t filehandle, uint16_t seq, bool compress) {
+	uint8_t slot = seq % VDPCHUNK_WINDOW;
+	uint8_t *frame = chunks[slot].frame;
+	uint8_t *input = (uint8_t *)VDPCHUNK_IN;
+	uint24_t bytesread, size = 0;
+	uint32_t filecrc, crc;
+
+	bytesread = source_read(filehandle, input, VDPCHUNK_SIZE);
+	crc32_suspend(&filecrc);
+	crc32_initialize();
+	crc32((char *)input, bytesread);
+	crc = crc32_finalize();
+	crc32_resume(&filecrc);
+	crc32((char *)input, bytesread);
+
+	if(slot == txslot) while(vdp_txbusy()); // a resent frame can still be going out
+	if(compress) size = lz4_compressblock(input, bytesread, frame + VDPCHUNK_HEADER, (uint16_t *)VDPLZ4_HASHTABLE);
+	if(size) frame[2] = VDPCHUNK_LZ4;
+	else {
+		size = bytesread;
+		memcpy(frame + VDPCHUNK_HEADER, input, size);
+		frame[2] = VDPCHUNK_STORED;
+	}
+	frame[0] = seq & 0xFF;
+	frame[1] = (seq >> 8) & 0xFF;
+	frame[3] = size & 0xFF;
+	frame[4] = (size >> 8) & 0xFF;
+	vdp_put32(frame + VDPCHUNK_HEADER + size, crc);
+	chunks[slot].length = VDPCHUNK_HEADER + size + VDPCHUNK_TRAILER;
+	chunks[slot].acked = false;
+}
+
+static void vdp_chunksend(uint16_t seq) {
+	uint8_t slot = seq % VDPCHUNK_WINDOW;
+
+	while(vdp_txbusy());
+	vdp_txstart(chunks[slot].frame, chunks[slot].length);
+	txslot = slot;
+	if(sink) chunks[slot].acked = true; // nobody to acknowledge
+}
+
+// Sends the file in chunks, up to VDPCHUNK_WINDOW of them in flight. A chunk the VDP reports
+// a CRC32 error for is sent again on its own. Without any acknowledgement for VDPCHUNK_TIMEOUT,
+// the transfer continues from the oldest chunk that wasn't acknowledged.
+// Returns false when the VDP aborts, or stops responding
+static bool vdp_sendchunked(uint8_t filehandle, uint24_t filesize, bool compress) {
+	uint16_t total = (filesize + VDPCHUNK_SIZE - 1) / VDPCHUNK_SIZE;
+	uint16_t base = 0, next = 0;
+	uint16_t seq;
+	uint8_t n, status, timeouts = 0;
+	uint32_t lastack;
+
+	for(n = 0; n < VDPCHUNK_WINDOW; n++) chunks[n].frame = (uint8_t *)(VDPCHUNK_SLOTS + (n * VDPCHUNK_SLOTSIZE));
+	txslot = VDPCHUNK_WINDOW;
+	chunksresent = 0;
+
+	lastack = timer_ticks();
+	while(true) {
+		while((base < next) && chunks[base % VDPCHUNK_WINDOW].acked) base++;
+		if(base == total) break;
+		// keep the window filled, reading the next chunk while the previous one goes out
+		if((next < total) && ((next - base) < VDPCHUNK_WINDOW)) {
+			vdp_chunkread(filehandle, next, compress);
+			vdp_chunksend(next);
+			next++;
+			continue;
+		}
+		if(vdp_ackpacket(&status, &seq)) {
+			if(status == VDPACK_ABORT) return false;
+			if((uint16_t)(seq - base) >= (next - base)) continue; // not in flight, a late duplicate
+			if(status == VDPACK_OK) chunks[seq % VDPCHUNK_WINDOW].acked = true;
+			else {
+				vdp_chunksend(seq);
+				chunksresent++;
+			}
+			lastack = timer_ticks();
+			timeouts = 0;
+			continue;
+		}
+		status_heartbeat();
+		if((timer_ticks() - lastack) > ((uint32_t)VDPCHUNK_TIMEOUT * TIMER_TICKS_PER_MS)) {
+			if(++timeouts > VDPCHUNK_RETRIES) return false;
+			for(seq = base; seq < next; seq++) {
+				if(chunks[seq % VDPCHUNK_WINDOW].acked) continue;
+				vdp_chunksend(seq);
+				chunksresent++;
+			}
+			lastack = timer_ticks();
+		}
+	}
+	while(vdp_txbusy());
+	return true;
+}
+
+// Sends the end frame, with the CRC32 the VDP checks the whole firmware against.
+// Returns true when the VDP accepts the firmware
+static bool vdp_chunkend(uint32_t crc) {
+	uint8_t frame[VDPCHUNK_HEADER + VDPCHUNK_TRAILER];
+	uint8_t n, status;
+	uint16_t seq;
+	uint32_t start;
+
+	frame[0] = VDPCHUNK_END & 0xFF;
+	frame[1] = (VDPCHUNK_END >> 8) & 0xFF;
+	frame[2] = VDPCHUNK_STORED;
+	frame[3] = 0;
+	frame[4] = 0;
+	vdp_put32(frame + VDPCHUNK_HEADER, crc);
+
+	for(n = 0; n <= VDPCHUNK_RETRIES; n++) {
+		vdp_send(frame, sizeof(frame));
+		if(sink) return true;
+		start = timer_ticks();
+		while((timer_ticks() - start) < ((uint32_t)VDPCHUNK_TIMEOUT * TIMER_TICKS_PER_MS)) {
+			if(vdp_ackpacket(&status, &seq) && (seq == VDPCHUNK_END)) return (status == VDPACK_OK);
+			status_heartbeat();
+		}
+	}
+	return false;
+}
+
+// Sends the firmware file to the OTA updater in the VDP. Depending on the mode:
+// VDPUPDATE_RAW     - 23,0,$A1,1,<24bit filesize>,<filedata>,<checksum>
+// VDPUPDATE_LZ4FILE - 23,0,$A1,2,<24bit filesize>,<LZ4 frame from the file>,<checksum>
+// VDPUPDATE_LZ4     - 23,0,$A1,2,0,0,0,<LZ4 frame, compressed while sending>,<checksum>
+// The checksum is the two's complement 8bit sum of the bytes sent after the size.
+// A streamed LZ4 frame runs up to its end mark, so its size is sent as 0.
+// When the file doesn't match a non-zero expected CRC32, a wrong checksum is sent,
+// so the VDP rejects the update instead of booting a corrupt firmware
+// VDPUPDATE_CHUNKED - 23,0,$A1,4,<24bit filesize>,<16bit chunk size>,<window>,<chunk frames>,<end frame>
+// Chunk frames can be compressed one by one (VDPUPDATE_CHUNKEDLZ4). The VDP acknowledges with
+// packets that are captured here, away from MOS, for the duration of the transfer.
+// The end frame carries the expected CRC32, or the CRC32 of the file without one.
+// Returns the CRC32 of the file
+uint32_t startVDPupdate(uint8_t filehandle, uint24_t filesize, uint8_t mode, uint32_t expectedcrc) {
+	uint8_t checksum;
+	uint8_t parameters[3] = {VDPCHUNK_SIZE & 0xFF, (VDPCHUNK_SIZE >> 8) & 0xFF, VDPCHUNK_WINDOW};
+	uint32_t crc;
+
+	crc32_initialize();
+	chunkfailed = false;
+
+	switch(mode) {
+		case VDPUPDATE_CHUNKED:
+		case VDPUPDATE_CHUNKEDLZ4:
+			if(!sink) uart0_rxcapture(true);
+			rxstate = 0;
+			vdp_start(VDPOTA_CHUNKED, filesize);
+			vdp_send(parameters, sizeof(parameters));
+			chunkfailed = !vdp_sendchunked(filehandle, filesize, mode == VDPUPDATE_CHUNKEDLZ4);
+			crc = crc32_finalize();
+			if(!chunkfailed) chunkfailed = !vdp_chunkend(expectedcrc ? expectedcrc : crc);
+			if(!sink) uart0_rxcapture(false);
+			return crc;
+		case VDPUPDATE_LZ4:
+			vdp_start(VDPOTA_LZ4, 0);
+			checksum = vdp_sendcompressed(filehandle);
+			break;
+		case VDPUPDATE_LZ4FILE:
+			vdp_start(VDPOTA_LZ4, filesize);
+			checksum = vdp_sendfile(filehandle);
+			break;
+		default:
+			vdp_start(VDPOTA_RAW, filesize);
+			checksum = vdp_sendfile(filehandle);
+			break;
+	}
+
+	crc = crc32_finalize();
+	checksum = -checksum; // two's complement
+	if(expectedcrc && (crc != expectedcrc)) checksum++;
+	vdp_send(&checksum, 1);
+	return crc;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef VDPUPDATE_H
+#define VDPUPDATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// OTA commands, following 23,0,$A1
+#define VDPOTA_UNLOCK	0
+#define VDPOTA_RAW		1
+#define VDPOTA_LZ4		2
+#define VDPOTA_IDENTITY	3	// prints the start of the running app ELF SHA256 in hex
+#define VDPOTA_CHUNKED	4	// chunks with a CRC32 and sequence number, each acknowledged
+
+// Capability characters the VDP prints directly after "unlocked!", and sends in its status packet
+#define VDPCAP_LZ4		'z'
+#define VDPCAP_IDENTITY	'i'
+#define VDPCAP_CHUNKED	'c'
+#define VDPCAPS			4	// capability characters, unused ones are 0 in the status packet
+
+#define VDPUPDATE_RAW		0	// file sent as-is
+#define VDPUPDATE_LZ4FILE	1	// LZ4 compressed file sent as-is
+#define VDPUPDATE_LZ4		2	// file compressed while sending
+#define VDPUPDATE_CHUNKED	3	// file sent in acknowledged chunks
+#define VDPUPDATE_CHUNKEDLZ4	4	// file sent in acknowledged chunks, each compressed
+
+#define VDPCHUNK_SIZE		4096	// file bytes per chunk
+#define VDPCHUNK_WINDOW		4		// chunks in flight before the first one needs to be acknowledged
+#define VDPCHUNK_HEADER		5		// <16bit sequence>,<flags>,<16bit payload length>
+#define VDPCHUNK_TRAILER	4		// <CRC32 of the chunk file bytes>
+#define VDPCHUNK_STORED		0x00	// payload flags
+#define VDPCHUNK_LZ4		0x01	// payload is an LZ4 block
+#define VDPCHUNK_END		0xFFFF	// sequence of the end frame, with the CRC32 of the whole file
+#define VDPCHUNK_TIMEOUT	1000	// ms without acknowledgements before resending from the oldest chunk
+#define VDPCHUNK_RETRIES	5		// timeouts in a row before giving up
+
+// Acknowledgement packet from the VDP: 0x80 | VDPOTA_ACKPACKET, 3, <status>, <16bit sequence>
+#define VDPOTA_ACKPACKET	0x21
+#define VDPACK_LENGTH		3
+#define VDPACK_OK			0
+#define VDPACK_RESEND		1		// CRC32 error, only this chunk is sent again
+#define VDPACK_ABORT		2		// VDP can't continue, or rejects the firmware at the end frame
+
+// Status packet from the VDP after VDPOTA_UNLOCK: 0x80 | VDPOTA_STATUSPACKET, 5, <unlocked>, <capabilities>
+// Older VDPs only print "unlocked!" and the capabilities on screen
+#define VDPOTA_STATUSPACKET	0x22
+#define VDPSTATUS_LENGTH	(1 + VDPCAPS)
+
+extern void vdpupdate_sink(bool enable);
+extern uint32_t vdpupdate_sinkbytes(void);
+extern uint8_t vdpupdate_sinksum(void);
+extern bool vdpupdate_failed(void);
+extern uint16_t vdpupdate_resent(void);
+extern bool vdpupdate_status(uint8_t *status, uint24_t timeoutms);
+extern uint32_t startVDPupdate(uint8_t filehandle, uint24_t filesize, uint8_t mode, uint32_t expectedcrc);
+
+#endif //VDPUPDATE_H